@@ -0,0 +1,127 @@
+// ZZTArena.c
+
+/*
+ 
+ Copyright (c) 2014, Paul Whitcomb
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * Neither the name of Paul Whitcomb nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ 
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "ZZTArena.h"
+#include "ZZTParallel.h"
+
+#define MAP_ARENA_ALIGNMENT 0x10
+
+struct MapArenaBlock {
+    MapArenaBlock *next;
+    size_t size;
+    size_t used;
+    size_t padding; //keeps data 16-byte aligned
+    char data[];
+};
+
+static THREAD_LOCAL MapArena *activeArena = NULL; //each thread has its own
+
+void mapArenaInit(MapArena *arena, size_t blockSize) {
+    arena->blocks = NULL;
+    arena->blockSize = blockSize ? blockSize : MAP_ARENA_DEFAULT_BLOCK;
+    arena->used = 0;
+    arena->peak = 0;
+}
+
+static MapArenaBlock *mapArenaAddBlock(MapArena *arena, size_t size) {
+    if(size < arena->blockSize) size = arena->blockSize;
+    MapArenaBlock *block = malloc(sizeof(MapArenaBlock) + size);
+    if(block == NULL) return NULL;
+    block->next = arena->blocks;
+    block->size = size;
+    block->used = 0;
+    arena->blocks = block;
+    return block;
+}
+
+void *mapArenaAlloc(MapArena *arena, size_t size) {
+    size = (size + MAP_ARENA_ALIGNMENT - 1) & ~(size_t)(MAP_ARENA_ALIGNMENT - 1);
+    MapArenaBlock *block = arena->blocks;
+    if(block == NULL || block->size - block->used < size) {
+        block = mapArenaAddBlock(arena, size);
+        if(block == NULL) return NULL;
+    }
+    void *pointer = block->data + block->used;
+    block->used += size;
+    arena->used += size;
+    if(arena->used > arena->peak) arena->peak = arena->used;
+    return pointer;
+}
+
+void *mapArenaCalloc(MapArena *arena, size_t size) {
+    void *pointer = mapArenaAlloc(arena, size);
+    if(pointer) memset(pointer, 0, size);
+    return pointer;
+}
+
+bool mapArenaOwns(const MapArena *arena, const void *pointer) {
+    for(const MapArenaBlock *block = arena->blocks;block;block = block->next) {
+        if((const char *)pointer >= block->data && (const char *)pointer < block->data + block->size) return true;
+    }
+    return false;
+}
+
+void mapArenaReset(MapArena *arena) { //collapses to one block big enough for the busiest run so far
+    if(arena->blocks != NULL && (arena->blocks->next != NULL || arena->blocks->size < arena->peak)) {
+        mapArenaFree(arena);
+        mapArenaAddBlock(arena, arena->peak);
+    }
+    else if(arena->blocks != NULL) {
+        arena->blocks->used = 0;
+    }
+    arena->used = 0;
+}
+
+void mapArenaFree(MapArena *arena) {
+    MapArenaBlock *block = arena->blocks;
+    while(block) {
+        MapArenaBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+    arena->blocks = NULL;
+    arena->used = 0;
+}
+
+void setDeathstarArena(MapArena *arena) {
+    activeArena = arena;
+}
+
+MapArena *getDeathstarArena(void) {
+    return activeArena;
+}
+
+void *deathstarAlloc(size_t size) {
+    if(activeArena) return mapArenaAlloc(activeArena, size);
+    return malloc(size);
+}
+
+void *deathstarCalloc(size_t size) {
+    if(activeArena) return mapArenaCalloc(activeArena, size);
+    return calloc(size, 0x1);
+}
+
+void deathstarFree(void *pointer) { //arena memory is released by mapArenaReset
+    if(pointer == NULL) return;
+    if(activeArena && mapArenaOwns(activeArena, pointer)) return;
+    free(pointer);
+}
@@ -0,0 +1,51 @@
+// ZZTArena.h
+
+/*
+ 
+ Copyright (c) 2014, Paul Whitcomb
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * Neither the name of Paul Whitcomb nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ 
+ */
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifndef deathstar_ZZTArena_h
+#define deathstar_ZZTArena_h
+
+#define MAP_ARENA_DEFAULT_BLOCK 0x4000000 //64 MiB
+
+typedef struct MapArenaBlock MapArenaBlock;
+
+typedef struct {
+    MapArenaBlock *blocks;       //newest first
+    size_t blockSize;            //minimum size of a new block
+    size_t used;                 //bytes handed out since the last reset
+    size_t peak;                 //largest value of used across resets
+} MapArena;
+
+void mapArenaInit(MapArena *arena, size_t blockSize);
+void *mapArenaAlloc(MapArena *arena, size_t size);
+void *mapArenaCalloc(MapArena *arena, size_t size);
+bool mapArenaOwns(const MapArena *arena, const void *pointer);
+void mapArenaReset(MapArena *arena);
+void mapArenaFree(MapArena *arena);
+
+void setDeathstarArena(MapArena *arena); //NULL goes back to malloc
+MapArena *getDeathstarArena(void);
+
+void *deathstarAlloc(size_t size);
+void *deathstarCalloc(size_t size);
+void deathstarFree(void *pointer);
+
+#endif
@@ -0,0 +1,101 @@
+// ZZTChecksum.c
+
+/*
+ 
+ Copyright (c) 2014, Paul Whitcomb
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * Neither the name of Paul Whitcomb nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ 
+ */
+
+#include <pthread.h>
+#include "ZZTChecksum.h"
+#include "ZZTTagData.h"
+#include "ZZTEngine.h"
+
+#define CRC32_POLYNOMIAL 0xEDB88320
+
+static uint32_t crcTables[8][256];
+static pthread_once_t crcTablesOnce = PTHREAD_ONCE_INIT;
+
+static void crc32BuildTables(void) { //slicing-by-8: table[n] advances a byte through n further zero bytes
+    for(uint32_t i=0;i<256;i++) {
+        uint32_t crc = i;
+        for(int bit=0;bit<8;bit++) {
+            crc = (crc >> 1) ^ (CRC32_POLYNOMIAL & (0 - (crc & 1)));
+        }
+        crcTables[0][i] = crc;
+    }
+    for(uint32_t i=0;i<256;i++) {
+        for(int table=1;table<8;table++) {
+            crcTables[table][i] = (crcTables[table - 1][i] >> 8) ^ crcTables[0][crcTables[table - 1][i] & 0xFF];
+        }
+    }
+}
+
+uint32_t crc32Update(uint32_t crc, const void *data, size_t length) {
+    pthread_once(&crcTablesOnce, crc32BuildTables); //watch mode checksums maps on several threads at once
+    
+    const unsigned char *bytes = data;
+    crc = ~crc;
+    
+    while(length > 0 && ((uintptr_t)bytes & 7) != 0) {
+        crc = (crc >> 8) ^ crcTables[0][(crc ^ *bytes++) & 0xFF];
+        length--;
+    }
+    while(length >= 8) {
+        uint32_t low, high;
+        memcpy(&low,bytes,4);
+        memcpy(&high,bytes + 4,4);
+        low ^= crc;
+        crc = crcTables[7][low & 0xFF] ^ crcTables[6][(low >> 8) & 0xFF] ^ crcTables[5][(low >> 16) & 0xFF] ^ crcTables[4][low >> 24]
+            ^ crcTables[3][high & 0xFF] ^ crcTables[2][(high >> 8) & 0xFF] ^ crcTables[1][(high >> 16) & 0xFF] ^ crcTables[0][high >> 24];
+        bytes += 8;
+        length -= 8;
+    }
+    while(length > 0) {
+        crc = (crc >> 8) ^ crcTables[0][(crc ^ *bytes++) & 0xFF];
+        length--;
+    }
+    return ~crc;
+}
+
+static uint32_t crc32Region(uint32_t crc, MapData map, uint32_t offset, uint32_t size) { //clamped to the map
+    if(offset >= map.length) return crc;
+    if(map.length - offset < size) size = map.length - offset;
+    return crc32Update(crc, map.buffer + offset, size);
+}
+
+uint32_t calculateMapChecksum(MapData map) { //BSPs, then model data, then tag data, like Halo CE
+    HaloMapHeader *header = (HaloMapHeader *)(map.buffer);
+    HaloMapIndex *index = (HaloMapIndex *)(map.buffer + header->indexOffset);
+    uint32_t magic = haloMapMagic(header);
+    MapTag *tags = (MapTag *)(map.buffer + (index->tagIndexOffset - magic));
+    uint32_t crc = 0;
+    
+    if(index->scenarioTag.tagTableIndex < index->tagCount) {
+        ScnrDependencies *scnr = (ScnrDependencies *)(map.buffer + (tags[index->scenarioTag.tagTableIndex].dataOffset - magic));
+        ScnrBSPs *bsps = (ScnrBSPs *)(map.buffer + (scnr->BSPs.offset - magic));
+        for(uint32_t i=0;i<scnr->BSPs.count;i++) {
+            crc = crc32Region(crc, map, bsps[i].fileOffset, bsps[i].tagSize);
+        }
+    }
+    crc = crc32Region(crc, map, index->vertexOffset, index->modelSize);
+    crc = crc32Region(crc, map, header->indexOffset, header->metaSize);
+    return crc;
+}
+
+uint32_t updateMapChecksum(MapData map) {
+    uint32_t crc = calculateMapChecksum(map);
+    ((HaloMapHeader *)(map.buffer))->crc32 = crc;
+    return crc;
+}
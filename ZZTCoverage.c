@@ -0,0 +1,54 @@
+// ZZTCoverage.c
+
+/*
+ 
+ Copyright (c) 2014, Paul Whitcomb
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * Neither the name of Paul Whitcomb nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ 
+ */
+
+#include "ZZTCoverage.h"
+
+void summarizeMapCoverage(MapCoverage *coverage, const uint32_t *classes) {
+    memset(coverage->counts, 0, sizeof(coverage->counts));
+    coverage->classes = malloc(sizeof(CoverageClassCount) * (coverage->tagCount ? coverage->tagCount : 1));
+    coverage->classCount = 0;
+    coverage->unreached = malloc(sizeof(uint32_t) * (coverage->tagCount ? coverage->tagCount : 1));
+    coverage->unreachedCount = 0;
+    for(uint32_t i=0;i<coverage->tagCount;i++) {
+        uint8_t kind = coverage->tags[i];
+        coverage->counts[kind]++;
+        if(kind == TAG_COVERAGE_UNREACHED) coverage->unreached[coverage->unreachedCount++] = i;
+        
+        uint32_t c = 0;
+        while(c < coverage->classCount && coverage->classes[c].tagClass != classes[i]) c++; //maps only use a few dozen classes
+        if(c == coverage->classCount) {
+            memset(&coverage->classes[c], 0, sizeof(CoverageClassCount));
+            coverage->classes[c].tagClass = classes[i];
+            coverage->classCount++;
+        }
+        coverage->classes[c].counts[kind]++;
+    }
+}
+
+void freeMapCoverage(MapCoverage *coverage) {
+    free(coverage->tags);
+    free(coverage->classes);
+    free(coverage->unreached);
+    coverage->tags = NULL;
+    coverage->classes = NULL;
+    coverage->unreached = NULL;
+    coverage->tagCount = 0;
+    coverage->classCount = 0;
+    coverage->unreachedCount = 0;
+}
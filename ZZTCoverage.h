@@ -0,0 +1,54 @@
+// ZZTCoverage.h
+
+/*
+ 
+ Copyright (c) 2014, Paul Whitcomb
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * Neither the name of Paul Whitcomb nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ 
+ */
+
+#include "ZZTDeathstar.h"
+
+#ifndef deathstar_ZZTCoverage_h
+#define deathstar_ZZTCoverage_h
+
+typedef enum {
+    TAG_COVERAGE_UNREACHED,      //nothing zteam follows refers to it, so its class wasn't checked
+    TAG_COVERAGE_GRAPH,          //reached from the scenario or globals
+    TAG_COVERAGE_COLLECTION,     //only reached from a tagc or Soul
+    TAG_COVERAGE_SWEEP,          //only reached by the dependency sweep
+    TAG_COVERAGE_SKIPPED,        //left alone on purpose: matg and external tags
+    TAG_COVERAGE_KINDS
+} TagCoverage;
+
+typedef struct {
+    uint32_t tagClass;           //after deprotection
+    uint32_t counts[TAG_COVERAGE_KINDS];
+} CoverageClassCount;
+
+typedef struct {
+    uint32_t tagCount;
+    uint8_t *tags;               //a TagCoverage for each tag
+    uint32_t counts[TAG_COVERAGE_KINDS];
+    CoverageClassCount *classes; //one entry per distinct class, in order of first appearance
+    uint32_t classCount;
+    uint32_t *unreached;         //tag indices, in tag order
+    uint32_t unreachedCount;
+} MapCoverage;
+
+DEATHSTAR_API MapCoverage zteam_coverage(MapData map, ZTeamOptions options); //runs zteam without changing the map, and records how each tag was reached
+DEATHSTAR_API void freeMapCoverage(MapCoverage *coverage);
+
+DEATHSTAR_API void summarizeMapCoverage(MapCoverage *coverage, const uint32_t *classes); //fills in the counts from coverage->tags and each tag's final class
+
+#endif
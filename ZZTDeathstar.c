@@ -17,17 +17,49 @@
  
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
 #include <time.h>
 #include "ZZTDeathstar.h"
 #include "ZZTTagData.h"
+#include "ZZTMapIndex.h"
+#include "ZZTArena.h"
+#include "ZZTStringTable.h"
+#include "ZZTParallel.h"
+#include "ZZTTrace.h"
+#include "ZZTEngine.h"
+#include "ZZTJournal.h"
+#include "ZZTCoverage.h"
+#include "ZZTPipeline.h"
+
+#include <errno.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#define read _read
+#define write _write
+#define close _close
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 
 
+static bool isValidHeader(const HaloMapHeader *header) {
+    return memcmp(&header->integrityHead, "daeh", 4) == 0 && memcmp(&header->integrityFoot, "toof", 4) == 0;
+}
+
 MapData openMapFromBuffer(void *buffer) {
+    TraceSpan span = traceBegin("validate header");
     MapData mapData;
     HaloMapHeader *mapHeader = ( HaloMapHeader *)(buffer);
-    if(mapHeader->integrityHead == *(uint32_t *)&"deah" && mapHeader->integrityFoot == *(uint32_t *)&"toof") {
+    if(!isValidHeader(mapHeader)) {
         mapData.error = MAP_INVALID_HEADER;
     }
     else if(mapHeader->indexOffset > mapHeader->length) {
@@ -38,29 +70,178 @@ MapData openMapFromBuffer(void *buffer) {
     }
     mapData.buffer = buffer;
     mapData.length = mapHeader->length;
+    mapData.ownership = MAP_BORROWED;
+    traceEnd(span);
     return mapData;
 }
 
+MapData openMapFromBufferWithLength(void *buffer, size_t length) {
+    TraceSpan span = traceBegin("validate header");
+    MapData mapData;
+    mapData.buffer = buffer;
+    mapData.length = 0;
+    mapData.ownership = MAP_BORROWED;
+    mapData.error = MAP_INVALID_HEADER;
+    HaloMapHeader *mapHeader = (HaloMapHeader *)(buffer);
+    if(length < sizeof(HaloMapHeader) || !isValidHeader(mapHeader) || mapHeader->length > length) {
+        traceEnd(span);
+        return mapData;
+    }
+    mapData.length = mapHeader->length;
+    
+    //everything deprotection reads before it follows tag data
+    mapData.error = MAP_INVALID_INDEX_POINTER;
+    if(mapHeader->indexOffset > mapData.length || mapData.length - mapHeader->indexOffset < sizeof(HaloMapIndex)) {
+        traceEnd(span);
+        return mapData;
+    }
+    HaloMapIndex *index = (HaloMapIndex *)(mapData.buffer + mapHeader->indexOffset);
+    uint32_t tagsOffset = index->tagIndexOffset - haloMapMagic(mapHeader);
+    if(tagsOffset < mapHeader->indexOffset || tagsOffset > mapData.length || (mapData.length - tagsOffset) / sizeof(MapTag) < index->tagCount || index->scenarioTag.tagTableIndex >= index->tagCount) {
+        traceEnd(span);
+        return mapData;
+    }
+    mapData.error = MAP_OK;
+    traceEnd(span);
+    return mapData;
+}
+
+MapData mapAllocate(uint32_t length) {
+    MapData map;
+    map.buffer = deathstarAlloc(length);
+    map.length = length;
+    map.error = MAP_OK;
+    map.ownership = getDeathstarArena() ? MAP_ARENA : MAP_OWNED;
+    return map;
+}
+
+void mapClose(MapData *map) {
+    if(map->buffer == NULL) return;
+    if(map->ownership == MAP_OWNED) {
+        free(map->buffer);
+    }
+#ifndef _WIN32
+    else if(map->ownership == MAP_MAPPED) {
+        munmap(map->buffer, map->length);
+    }
+#endif
+    map->buffer = NULL;
+    map->length = 0;
+}
+
 MapData openMapAtPath(const char *path) {
-    FILE *map = fopen(path,"r");
+    FILE *map = fopen(path,"rb");
     if(map)
     {
         fseek(map,0x0,SEEK_END);
-        uint32_t length = (uint32_t)ftell(map);
+        long fileLength = ftell(map);
+        uint32_t length = fileLength > 0 && (uint64_t)fileLength <= UINT32_MAX ? (uint32_t)fileLength : 0; //map lengths are 32-bit; anything bigger isn't a map
         fseek(map,0x0,SEEK_SET);
-        void *buffer = malloc(length);
-        fread(buffer,length,0x1,map);
+        TraceSpan span = traceBegin("load map");
+        MapData file = mapAllocate(length > 0 ? length : 1);
+        bool complete = length > 0 && fread(file.buffer,length,0x1,map) == 1;
         fclose(map);
-        return openMapFromBuffer(buffer);
+        traceEnd(span);
+        MapData mapData = openMapFromBufferWithLength(file.buffer, complete ? (size_t)length : 0);
+        mapData.ownership = file.ownership;
+        if(mapData.error != MAP_OK) {
+            mapData.length = file.length;
+            mapClose(&mapData);
+        }
+        return mapData;
     }
     else {
         MapData invalidMap;
+        invalidMap.buffer = NULL;
+        invalidMap.length = 0;
         invalidMap.error = MAP_INVALID_PATH;
+        invalidMap.ownership = MAP_BORROWED;
+        return invalidMap;
+    }
+}
+
+#define MAP_STREAM_CHUNK 0x100000 //1 MiB
+
+typedef size_t (*MapStreamRead)(void *source, char *buffer, size_t size, bool *failed); //0 at the end of the stream
+
+static size_t readFromFile(void *source, char *buffer, size_t size, bool *failed) {
+    size_t count = fread(buffer, 1, size, (FILE *)source);
+    if(count == 0 && ferror((FILE *)source)) *failed = true;
+    return count;
+}
+
+static size_t readFromDescriptor(void *source, char *buffer, size_t size, bool *failed) {
+    int descriptor = *(int *)source;
+    while(true) {
+        long count = (long)read(descriptor, buffer, (unsigned int)(size < 0x40000000 ? size : 0x40000000));
+        if(count < 0 && errno == EINTR) continue;
+        if(count < 0) *failed = true;
+        return count > 0 ? (size_t)count : 0;
+    }
+}
+
+static MapData openMapFromSource(MapStreamRead readSource, void *source) { //pipes can't seek, so the buffer grows as data arrives
+    MapData invalidMap;
+    invalidMap.buffer = NULL;
+    invalidMap.length = 0;
+    invalidMap.error = MAP_INVALID_PATH;
+    invalidMap.ownership = MAP_OWNED;
+    
+    TraceSpan span = traceBegin("load map");
+    size_t capacity = MAP_STREAM_CHUNK;
+    size_t length = 0;
+    bool failed = false;
+    bool complete = false;
+    bool sized = false;
+    char *buffer = malloc(capacity);
+    while(buffer && !failed) {
+        if(!sized && length >= sizeof(HaloMapHeader)) { //once the header is in, make room for the whole map and a byte more to see the end
+            uint32_t headerLength = ((HaloMapHeader *)buffer)->length;
+            if(isValidHeader((HaloMapHeader *)buffer) && headerLength >= capacity && headerLength < UINT32_MAX) {
+                char *grown = realloc(buffer, (size_t)headerLength + 1);
+                if(grown == NULL) break;
+                buffer = grown;
+                capacity = (size_t)headerLength + 1;
+            }
+            sized = true;
+        }
+        if(length == capacity) {
+            if(capacity >= UINT32_MAX) break; //no map is that big
+            size_t grownCapacity = capacity > UINT32_MAX / 2 ? UINT32_MAX : capacity * 2;
+            char *grown = realloc(buffer, grownCapacity);
+            if(grown == NULL) break;
+            buffer = grown;
+            capacity = grownCapacity;
+        }
+        size_t count = readSource(source, buffer + length, capacity - length, &failed);
+        if(count == 0) {
+            complete = !failed;
+            break;
+        }
+        length += count;
+    }
+    traceEnd(span);
+    
+    if(!complete) {
+        free(buffer);
         return invalidMap;
     }
+    MapData mapData = openMapFromBufferWithLength(buffer, length);
+    mapData.ownership = MAP_OWNED;
+    if(mapData.error != MAP_OK) {
+        mapData.length = (uint32_t)length;
+        mapClose(&mapData);
+    }
+    return mapData;
+}
+
+MapData openMapFromStream(FILE *stream) {
+    return openMapFromSource(readFromFile, stream);
 }
 
-#define META_MEMORY_OFFSET 0x40440000 //Halo CE and Halo PC ONLY
+MapData openMapFromDescriptor(int descriptor) {
+    return openMapFromSource(readFromDescriptor, &descriptor);
+}
 
 static void zteam_deprotectClass(TagID tagId, char class[4]);
 static void zteam_deprotectObjectTag(TagID tagId); //bipd, vehi, weap, eqip, garb, proj, scen, mach, ctrl, lifi, plac, obje, ssce
@@ -93,8 +274,6 @@ static void zteam_deprotectAnt(TagID tagId);
 static void zteam_deprotectPctl(TagID tagId);
 static void zteam_deprotectActv(TagID tagId);
 
-bool haloCEmap = false;
-
 typedef enum {
     OBJECT_BIPD = 0x0,
     OBJECT_VEHI = 0x1,
@@ -125,29 +304,101 @@ typedef enum {
     SHADER_SPLA = 0xB
 } TagShaderType; //0x24
 
-bool *deprotectedTags; //check for CERTAIN tags
+static const char objectTypeClasses[][4] = { //indexed by TagObjectType
+    BIPD, VEHI, WEAP, EQIP, GARB, PROJ, SCEN, MACH, CTRL, LIFI, PLAC, SSCE
+};
+
+static const char shaderTypeClasses[][4] = { //indexed by TagShaderType
+    SHDR, SHDR, SHDR, SENV, SOSO, SOTR, SCHI, SCEX, SWAT, SGLA, SMET, SPLA
+};
+
+static THREAD_LOCAL bool *deprotectedTags; //check for CERTAIN tags
+static THREAD_LOCAL bool *recoveredTags; //tags given a class by zteam_changeTagClass
 
-MapTag *tagArray;
-uint32_t tagCount;
+static THREAD_LOCAL MapTag *tagArray;
+static THREAD_LOCAL uint32_t tagCount;
+static THREAD_LOCAL MapTagIndex tagIndex;
 
-uint32_t magic;
+static THREAD_LOCAL uint32_t magic;
 
-char *mapdata;
-uint32_t mapdataSize;
-uint32_t tagdataSize;
+static THREAD_LOCAL char *mapdata;
+static THREAD_LOCAL uint32_t mapdataSize;
+static THREAD_LOCAL uint32_t tagdataSize;
+
+static THREAD_LOCAL bool localityOrder; //see ZTeamOptions
+static THREAD_LOCAL MapJournal *journal; //set by zteam_deprotectJournal, which leaves the map alone
+static THREAD_LOCAL MapCoverage *coverage; //set by zteam_coverage
+static THREAD_LOCAL uint8_t coverageSource; //the TagCoverage of tags reached from here on
 
 int saveMap(const char *path, MapData map) {
     FILE *mapFile = fopen(path,"wb");
     if(mapFile) {
-        fwrite(map.buffer,1,map.length,mapFile);
-        fclose(mapFile);
-        return 0;
+        int result = saveMapToStream(mapFile, map);
+        if(fclose(mapFile) != 0) result = 1;
+        return result;
     }
     return 1;
 }
 
+int saveMapReplacing(const char *path, MapData map) {
+    size_t length = strlen(path);
+    char *temporaryPath = malloc(length + sizeof(".XXXXXX"));
+    memcpy(temporaryPath, path, length);
+    memcpy(temporaryPath + length, ".XXXXXX", sizeof(".XXXXXX"));
+#ifdef _WIN32
+    int descriptor = _mktemp(temporaryPath) ? _open(temporaryPath, _O_WRONLY | _O_CREAT | _O_EXCL | _O_BINARY, _S_IREAD | _S_IWRITE) : -1;
+#else
+    int descriptor = mkstemp(temporaryPath);
+#endif
+    if(descriptor < 0) {
+        free(temporaryPath);
+        return 1;
+    }
+#ifndef _WIN32
+    struct stat info;
+    fchmod(descriptor, stat(path, &info) == 0 ? info.st_mode & 07777 : 0644); //mkstemp only lets the owner read it
+#endif
+    int result = saveMapToDescriptor(descriptor, map);
+    if(close(descriptor) != 0) result = 1;
+#ifdef _WIN32
+    if(result == 0) remove(path); //rename does not replace existing files on Windows
+#endif
+    if(result == 0 && rename(temporaryPath, path) != 0) result = 1;
+    if(result != 0) remove(temporaryPath);
+    free(temporaryPath);
+    return result;
+}
+
+int saveMapToStream(FILE *stream, MapData map) {
+    TraceSpan span = traceBegin("save map");
+    bool complete = fwrite(map.buffer,1,map.length,stream) == map.length && fflush(stream) == 0;
+    traceEnd(span);
+    return complete ? 0 : 1;
+}
+
+int saveMapToDescriptor(int descriptor, MapData map) {
+    TraceSpan span = traceBegin("save map");
+    const char *data = map.buffer;
+    uint32_t remaining = map.length;
+    while(remaining > 0) {
+        long written = (long)write(descriptor, data, remaining < 0x40000000 ? remaining : 0x40000000);
+        if(written < 0 && errno == EINTR) continue;
+        if(written <= 0) break;
+        data += written;
+        remaining -= (uint32_t)written;
+    }
+    traceEnd(span);
+    return remaining == 0 ? 0 : 1;
+}
+
+static uint32_t tagIDValue(TagID tag) { //the tag ID as the word it's stored as
+    uint32_t value;
+    memcpy(&value, &tag, sizeof(value));
+    return value;
+}
+
 static bool isNulledOut(TagID tag) {
-    return (tag.tableIndex == 0 && tag.tagTableIndex == 0) || tag.tagTableIndex > tagCount;
+    return (tag.tableIndex == 0 && tag.tagTableIndex == 0) || tag.tagTableIndex >= tagCount;
 }
 
 static void *translatePointer(uint32_t pointer) { //translates a map pointer to where it points to in the currently loaded buffer
@@ -157,7 +408,11 @@ static void *translatePointer(uint32_t pointer) { //translates a map pointer to
 static void zteam_changeTagClass(TagID tagId,const char *class) {
     if(isNulledOut(tagId)) return;
     if(deprotectedTags[tagId.tagTableIndex]) return;
-    tagArray[tagId.tagTableIndex].classA = *(uint32_t *)(class);
+    if(coverage && tagId.tagTableIndex < tagCount && coverage->tags[tagId.tagTableIndex] == TAG_COVERAGE_UNREACHED) coverage->tags[tagId.tagTableIndex] = coverageSource;
+    if(journal) mapJournalRecord(journal, tagId.tagTableIndex, MAP_JOURNAL_TAG_CLASS, tagIndex.classA[tagId.tagTableIndex], *(uint32_t *)(class));
+    else tagArray[tagId.tagTableIndex].classA = *(uint32_t *)(class);
+    tagIndex.classA[tagId.tagTableIndex] = *(uint32_t *)(class);
+    if(recoveredTags) recoveredTags[tagId.tagTableIndex] = true;
 }
 
 static inline void zteam_deprotectMultitextureOverlay(TagReflexive reflexive) {
@@ -169,8 +424,66 @@ static inline void zteam_deprotectMultitextureOverlay(TagReflexive reflexive) {
     }
 }
 
+#if defined(__GNUC__)
+#define PREFETCH(address) __builtin_prefetch(address)
+#else
+#define PREFETCH(address) ((void)(address))
+#endif
+
+typedef struct {
+    TagID tagId;
+    char mainClass[4];           //only used by zteam_visitClass
+    uint32_t dataOffset;
+    uint32_t order;              //keeps references to the same tag in the order they were found
+} ZTeamVisit;
+
+typedef void (*ZTeamVisitor)(const ZTeamVisit *visit);
+
+static void zteam_visitClass(const ZTeamVisit *visit) {
+    char mainClass[4];
+    memcpy(mainClass, visit->mainClass, sizeof(mainClass));
+    zteam_deprotectClass(visit->tagId, mainClass);
+}
+
+static void zteam_visitObject(const ZTeamVisit *visit) {
+    zteam_deprotectObjectTag(visit->tagId);
+}
+
+static int compareVisits(const void *a, const void *b) {
+    const ZTeamVisit *visitA = a;
+    const ZTeamVisit *visitB = b;
+    if(visitA->dataOffset != visitB->dataOffset) return visitA->dataOffset < visitB->dataOffset ? -1 : 1;
+    return visitA->order < visitB->order ? -1 : visitA->order > visitB->order;
+}
+
+static void zteam_addVisit(ZTeamVisit *visits, uint32_t *count, TagID tagId, const char *mainClass) {
+    if(isNulledOut(tagId)) return;
+    ZTeamVisit *visit = &visits[*count];
+    visit->tagId = tagId;
+    if(mainClass) memcpy(visit->mainClass, mainClass, sizeof(visit->mainClass));
+    visit->dataOffset = tagArray[tagId.tagTableIndex].dataOffset;
+    visit->order = (*count)++;
+}
+
+static void zteam_visitBatch(ZTeamVisit *visits, uint32_t count, ZTeamVisitor visitor) { //walks a batch in the order the tags are stored
+    if(localityOrder) qsort(visits, count, sizeof(ZTeamVisit), compareVisits);
+    for(uint32_t i=0;i<count;i++) {
+        if(i + 1 < count) PREFETCH(translatePointer(visits[i + 1].dataOffset));
+        visitor(&visits[i]);
+    }
+}
+
 static inline void zteam_deprotectDependencyArray(Dependency *tags,uint32_t count, char *class) {
-    if(class == NULL) {
+    if(class == NULL && localityOrder) {
+        ZTeamVisit *visits = deathstarAlloc(sizeof(ZTeamVisit) * count + 1);
+        uint32_t visitCount = 0;
+        for(uint32_t i=0;i<count;i++) {
+            zteam_addVisit(visits, &visitCount, tags[i].tagId, tags[i].mainClass);
+        }
+        zteam_visitBatch(visits, visitCount, zteam_visitClass);
+        deathstarFree(visits);
+    }
+    else if(class == NULL) {
         for(uint32_t i=0;i<count;i++) {
             zteam_deprotectClass(tags[i].tagId, tags[i].mainClass);
         }
@@ -257,24 +570,10 @@ static void zteam_deprotectColl(TagID tagId) {
 static void zteam_deprotectShdr(TagID tagId) {
     if(isNulledOut(tagId)) return; //however, this also means the map is broken
     if(deprotectedTags[tagId.tagTableIndex]) return;
-    uint32_t tagClasses[] = {
-        *(uint32_t *)&SHDR,
-        *(uint32_t *)&SHDR,
-        *(uint32_t *)&SHDR,
-        *(uint32_t *)&SENV,
-        *(uint32_t *)&SOSO,
-        *(uint32_t *)&SOTR,
-        *(uint32_t *)&SCHI,
-        *(uint32_t *)&SCEX,
-        *(uint32_t *)&SWAT,
-        *(uint32_t *)&SGLA,
-        *(uint32_t *)&SMET,
-        *(uint32_t *)&SPLA
-    };
     void *location = translatePointer(tagArray[tagId.tagTableIndex].dataOffset);
     Shader shdr = *(Shader *)location;
-    if(shdr.type < 0x3 || shdr.type > sizeof(tagClasses) / 0x4) return;
-    zteam_changeTagClass(tagId, (const char *)&tagClasses[shdr.type]);
+    if(shdr.type < 0x3 || shdr.type >= sizeof(shaderTypeClasses) / 0x4) return;
+    zteam_changeTagClass(tagId, shaderTypeClasses[shdr.type]);
     if(shdr.type == SHADER_SCEX) {
         ShaderScexDependencies scex = *(ShaderScexDependencies *)location;
         ShaderShaderLayersDependencies *layers = translatePointer(scex.layers.offset);
@@ -546,30 +845,15 @@ static void zteam_deprotectObjectTag(TagID tagId) {
     if(isNulledOut(tagId)) return;
     if(deprotectedTags[tagId.tagTableIndex]) return;
     
-    uint32_t tagClasses[] = {
-        *(uint32_t *)&BIPD,
-        *(uint32_t *)&VEHI,
-        *(uint32_t *)&WEAP,
-        *(uint32_t *)&EQIP,
-        *(uint32_t *)&GARB,
-        *(uint32_t *)&PROJ,
-        *(uint32_t *)&SCEN,
-        *(uint32_t *)&MACH,
-        *(uint32_t *)&CTRL,
-        *(uint32_t *)&LIFI,
-        *(uint32_t *)&PLAC,
-        *(uint32_t *)&SSCE
-    };
-    
     void *objectTag = translatePointer(tagArray[tagId.tagTableIndex].dataOffset);
     ObjeDependencies object = *( ObjeDependencies *)objectTag;
     
-    if(object.tagObjectType > sizeof(tagClasses) / 0x4)
+    if(object.tagObjectType >= sizeof(objectTypeClasses) / 0x4)
     {
         zteam_changeTagClass(tagId, OBJE); //failed to ID tag
     }
     else {
-        zteam_changeTagClass(tagId,(const char *)&tagClasses[object.tagObjectType]);
+        zteam_changeTagClass(tagId,objectTypeClasses[object.tagObjectType]);
     }
     
     deprotectedTags[tagId.tagTableIndex] = true;
@@ -737,6 +1021,16 @@ static void zteam_deprotectCont(TagID tagId) {
 
 static inline void zteam_deprotectObjectPalette(TagReflexive reflexive) {
     ScnrPaletteDependency *palette = (ScnrPaletteDependency *)translatePointer(reflexive.offset);
+    if(localityOrder) {
+        ZTeamVisit *visits = deathstarAlloc(sizeof(ZTeamVisit) * reflexive.count + 1);
+        uint32_t visitCount = 0;
+        for(uint32_t i=0;i<reflexive.count;i++) {
+            zteam_addVisit(visits, &visitCount, palette[i].object.tagId, NULL);
+        }
+        zteam_visitBatch(visits, visitCount, zteam_visitObject);
+        deathstarFree(visits);
+        return;
+    }
     for(int i=0;i<reflexive.count;i++) {
         zteam_deprotectObjectTag(palette[i].object.tagId);
     }
@@ -1016,98 +1310,372 @@ static void zteam_deprotectSky(TagID tagId) {
 #define MATCHING_THRESHOLD 0.7
 #define MAX_TAG_NAME_SIZE 0x50
 
+static bool name_isRenamed(const MapTagIndex *index, uint32_t i) { //takes the index so worker threads can call it
+    if(!classCanBeDeprotected(index->classA[i])) return false;
+    return (index->flags[i] & (TAG_INDEX_EXTERNAL | TAG_INDEX_SHARED_NAME)) == 0;
+}
+
+static uint32_t name_generate(char *destination, const char *mapName, uint32_t tagClass, uint32_t i) { //returns the bytes used, including the terminator
+    const char *genericName = "deathstar\\%s\\%s\\tag_%u";
+    const char *tagClassName = translateHaloClassToName(tagClass);
+    int newname_length = snprintf(destination, MAX_TAG_NAME_SIZE, genericName, mapName, tagClassName, i);
+    if(newname_length > MAX_TAG_NAME_SIZE - 1) {
+        newname_length = MAX_TAG_NAME_SIZE - 1;
+    }
+    return newname_length + 0x1;
+}
+
+static uint32_t name_stringLength(uint32_t offset, uint32_t end) { //bounded strlen, including the terminator
+    const char *terminator = memchr(mapdata + offset, 0, end - offset);
+    return terminator ? (uint32_t)(terminator - (mapdata + offset)) + 1 : end - offset;
+}
+
+static int name_compareNameOffsets(const void *a, const void *b) {
+    uint32_t offsetA = tagIndex.nameOffset[*(const uint32_t *)a];
+    uint32_t offsetB = tagIndex.nameOffset[*(const uint32_t *)b];
+    return offsetA < offsetB ? -1 : offsetA > offsetB;
+}
+
+static void name_rewriteDependencyNames(MapData map, uint32_t regionStart, uint32_t regionEnd) { //Dependency names pointing into the old strings follow their tag
+    MapRegion regions[MAX_METADATA_REGIONS];
+    uint32_t regionCount = findMetadataRegions(map, regions);
+    for(uint32_t r=0;r<regionCount;r++) {
+        for(uint32_t offset=regions[r].offset;offset + sizeof(Dependency) <= regions[r].offset + regions[r].size;offset += 4) {
+            Dependency *dependency = (Dependency *)(mapdata + offset);
+            if(dependency->nameOffset < regionStart + magic || dependency->nameOffset >= regionEnd + magic) continue;
+            if(dependency->zero != 0 || !isHaloClass(*(uint32_t *)dependency->mainClass)) continue;
+            if(isNulledOut(dependency->tagId)) {
+                dependency->nameOffset = 0;
+            }
+            else if(tagIDValue(tagArray[dependency->tagId.tagTableIndex].identity) == tagIDValue(dependency->tagId)) {
+                dependency->nameOffset = tagArray[dependency->tagId.tagTableIndex].nameOffset;
+            }
+        }
+    }
+}
+
+static bool name_compactNames(MapData map, const char *mapName) { //false if the names can't be rewritten in place
+    HaloMapHeader *header = (HaloMapHeader *)(map.buffer);
+    uint32_t metaEnd = header->indexOffset + header->metaSize;
+    if(metaEnd > map.length || metaEnd < header->indexOffset) metaEnd = map.length;
+    
+    uint32_t *order = deathstarAlloc(sizeof(uint32_t) * tagCount);
+    uint32_t nameCount = 0;
+    for(uint32_t i=0;i<tagCount;i++) {
+        if((tagIndex.flags[i] & TAG_INDEX_NAME_IN_MAP) && tagIndex.nameOffset[i] - magic < metaEnd) order[nameCount++] = i;
+    }
+    if(nameCount == 0) {
+        deathstarFree(order);
+        return false;
+    }
+    qsort(order, nameCount, sizeof(uint32_t), name_compareNameOffsets);
+    
+    //the region must hold nothing but tag names and zero padding
+    uint32_t regionStart = tagIndex.nameOffset[order[0]] - magic;
+    uint32_t regionEnd = regionStart;
+    bool usable = true;
+    for(uint32_t i=0;i<nameCount && usable;i++) {
+        uint32_t nameStart = tagIndex.nameOffset[order[i]] - magic;
+        for(uint32_t gap=regionEnd;gap<nameStart && usable;gap++) {
+            usable = mapdata[gap] == 0;
+        }
+        uint32_t nameEnd = nameStart + name_stringLength(nameStart, metaEnd);
+        if(nameEnd > regionEnd) regionEnd = nameEnd;
+    }
+    deathstarFree(order);
+    
+    uint32_t tagsStart = (uint32_t)((char *)tagArray - mapdata);
+    uint32_t tagsEnd = tagsStart + tagCount * sizeof(MapTag);
+    if(tagsStart < regionEnd && regionStart < tagsEnd) usable = false;
+    for(uint32_t i=0;i<tagCount && usable;i++) {
+        uint32_t dataStart = tagIndex.dataOffset[i] - magic;
+        if(!(tagIndex.flags[i] & TAG_INDEX_EXTERNAL) && dataStart >= regionStart && dataStart < regionEnd) usable = false;
+    }
+    if(!usable) return false;
+    
+    uint32_t regionSize = regionEnd - regionStart;
+    char *names = deathstarAlloc(tagCount * MAX_TAG_NAME_SIZE);
+    char *keptNames = deathstarAlloc(regionSize + 1); //kept names are used at full length, terminated even if the last one runs to the end of the meta
+    memcpy(keptNames, mapdata + regionStart, regionSize);
+    keptNames[regionSize] = 0;
+    const char **strings = deathstarAlloc(sizeof(char *) * tagCount);
+    uint32_t *tags = deathstarAlloc(sizeof(uint32_t) * tagCount);
+    uint32_t stringCount = 0;
+    for(uint32_t i=0;i<tagCount;i++) {
+        const char *name = names + i * MAX_TAG_NAME_SIZE;
+        if(name_isRenamed(&tagIndex, i)) {
+            name_generate(names + i * MAX_TAG_NAME_SIZE, mapName, tagIndex.classA[i], i);
+        }
+        else if((tagIndex.flags[i] & TAG_INDEX_NAME_IN_MAP) && tagIndex.nameOffset[i] - magic < metaEnd) {
+            name = keptNames + (tagIndex.nameOffset[i] - magic - regionStart);
+        }
+        else {
+            continue; //left where it is
+        }
+        strings[stringCount] = name;
+        tags[stringCount++] = i;
+    }
+    
+    StringTable table = buildStringTable(strings, stringCount);
+    bool fits = table.length <= regionSize;
+    if(fits) {
+        memcpy(mapdata + regionStart, table.buffer, table.length);
+        memset(mapdata + regionStart + table.length, 0, regionSize - table.length);
+        for(uint32_t i=0;i<stringCount;i++) {
+            tagArray[tags[i]].nameOffset = regionStart + table.offsets[i] + magic;
+        }
+        name_rewriteDependencyNames(map, regionStart, regionEnd);
+    }
+    freeStringTable(&table);
+    deathstarFree(tags);
+    deathstarFree(strings);
+    deathstarFree(keptNames);
+    deathstarFree(names);
+    return fits;
+}
+
+typedef struct {
+    const char *mapName;
+    char *names;            //one MAX_TAG_NAME_SIZE slot per tag
+    uint32_t *lengths;      //0 for tags that keep their name
+    const MapTagIndex *index; //the map globals are thread-local, so workers are handed them here
+} NameJob;
+
+static void name_generateSlice(void *context, uint32_t start, uint32_t end) {
+    TraceSpan span = traceBegin("name generate slice");
+    NameJob *job = context;
+    for(uint32_t i=start;i<end;i++) {
+        job->lengths[i] = name_isRenamed(job->index, i) ? name_generate(job->names + i * MAX_TAG_NAME_SIZE, job->mapName, job->index->classA[i], i) : 0;
+    }
+    traceEnd(span);
+}
+
+static uint32_t name_appendNames(const char *mapName, uint32_t length, uint32_t threads) { //returns the size of the names written at length
+    NameJob job;
+    job.mapName = mapName;
+    job.index = &tagIndex;
+    job.names = deathstarAlloc(tagCount * MAX_TAG_NAME_SIZE);
+    job.lengths = deathstarAlloc(sizeof(uint32_t) * tagCount);
+    parallelFor(tagCount, threads, name_generateSlice, &job);
+    
+    //the table is built from the names in tag order however many threads made them, so the layout doesn't depend on --threads
+    const char **strings = deathstarAlloc(sizeof(char *) * tagCount);
+    uint32_t *tags = deathstarAlloc(sizeof(uint32_t) * tagCount);
+    uint32_t stringCount = 0;
+    for(uint32_t i=0;i<tagCount;i++) {
+        if(job.lengths[i] == 0) continue;
+        strings[stringCount] = job.names + i * MAX_TAG_NAME_SIZE;
+        tags[stringCount++] = i;
+    }
+    
+    StringTable table = buildStringTable(strings, stringCount);
+    memcpy(mapdata + length, table.buffer, table.length);
+    for(uint32_t i=0;i<stringCount;i++) {
+        tagArray[tags[i]].nameOffset = length + table.offsets[i] + magic;
+    }
+    
+    uint32_t namesLength = table.length;
+    freeStringTable(&table);
+    deathstarFree(tags);
+    deathstarFree(strings);
+    deathstarFree(job.lengths);
+    deathstarFree(job.names);
+    return namesLength;
+}
+
 MapData name_deprotect(MapData map) {
+    NameDeprotectOptions options;
+    options.layout = NAME_LAYOUT_APPEND;
+    options.threads = 1;
+    return name_deprotectWithOptions(map, options);
+}
+
+MapData name_deprotectWithOptions(MapData map, NameDeprotectOptions options) {
+    return name_deprotectWithIndex(map, options, NULL);
+}
+
+MapData name_deprotectWithIndex(MapData map, NameDeprotectOptions options, const MapTagIndex *sharedIndex) {
+    TraceSpan span = traceBegin("name_deprotect");
     uint32_t length = map.length;
     
     HaloMapHeader *headerOldMap = ( HaloMapHeader *)(map.buffer);
     HaloMapIndex *indexOldMap = (HaloMapIndex *)(map.buffer + headerOldMap->indexOffset);
     tagCount = indexOldMap->tagCount;
     
-    char *modded_buffer = calloc(map.length + MAX_TAG_NAME_SIZE * tagCount,0x1);
+    MapData new_map = mapAllocate(map.length + MAX_TAG_NAME_SIZE * tagCount);
+    char *modded_buffer = new_map.buffer;
     
     memcpy(modded_buffer,map.buffer,length);
+    memset(modded_buffer + length,0,new_map.length - length);
+    new_map.length = length;
     
     HaloMapHeader *header = ( HaloMapHeader *)(modded_buffer);
     HaloMapIndex *index = ( HaloMapIndex *)(modded_buffer + header->indexOffset);
     
-    haloCEmap = header->version == 609;
-    
     mapdata = modded_buffer;
-    magic = META_MEMORY_OFFSET - header->indexOffset;
-    
-    char *names = modded_buffer + length;
-    int namesLength = 0x0;
+    magic = haloMapMagic(header);
     
     tagArray = ( MapTag *)(translatePointer(index->tagIndexOffset));
     tagCount = index->tagCount;
+    tagIndex = sharedIndex ? *sharedIndex : buildMapTagIndex(new_map); //the copy has the same tag array
     
-    for(uint32_t i=0;i<tagCount;i++) {
-        if(!classCanBeDeprotected(tagArray[i].classA)) {
-            continue;
-        }
-        
-        if(haloCEmap && tagArray[i].notInsideMap)
-        continue;
-        if(!(tagArray[i].nameOffset < META_MEMORY_OFFSET || tagArray[i].nameOffset > META_MEMORY_OFFSET + header->metaSize)) {
-            if(strncmp(translatePointer(tagArray[i].nameOffset),"ui\\",3) == 0)
-            continue;
-            if(strncmp(translatePointer(tagArray[i].nameOffset),"sound\\",6) == 0)
-            continue;
-        }
-        
-        const char *genericName = "deathstar\\%s\\%s\\tag_%u";
-        const char *tagClassName = translateHaloClassToName(tagArray[i].classA);
-        sprintf(names + namesLength,genericName,headerOldMap->name,tagClassName,i);
-        
-        tagArray[i].nameOffset = length + namesLength + magic;
-        
-        size_t newname_length = strlen(names + namesLength);
-        if(newname_length > MAX_TAG_NAME_SIZE - 1) {
-            newname_length = MAX_TAG_NAME_SIZE - 1;
-        }
-        
-        namesLength += newname_length + 0x1;
+    if(options.layout == NAME_LAYOUT_COMPACT && name_compactNames(new_map, headerOldMap->name)) {
+        if(!sharedIndex) freeMapTagIndex(&tagIndex);
+        traceEnd(span);
+        return new_map;
     }
     
+    uint32_t namesLength = name_appendNames(headerOldMap->name, length, options.threads);
     uint32_t new_length = length + namesLength;
     
     header->length = new_length;
     header->metaSize = new_length - header->indexOffset;
     
-    MapData new_map;
-    new_map.buffer = modded_buffer;
+    if(!sharedIndex) freeMapTagIndex(&tagIndex);
+    
     new_map.length = new_length;
-    new_map.error = MAP_OK;
+    traceEnd(span);
     return new_map;
 }
 
-MapData zteam_deprotect(MapData map)
+static bool isShaderClass(uint32_t class);
+
+static void zteam_sweepDependency(const Dependency *dependency) { //feeds a reference the walkers didn't follow into the same class recovery
+    uint32_t tag = dependency->tagId.tagTableIndex;
+    if(tag >= tagCount || recoveredTags[tag] || deprotectedTags[tag]) return;
+    if(dependency->zero != 0 || tagIDValue(tagArray[tag].identity) != tagIDValue(dependency->tagId)) return;
+    uint32_t class = *(uint32_t *)dependency->mainClass;
+    if(!isHaloClass(class)) return;
+    if(isShaderClass(class)) {
+        zteam_deprotectShdr(dependency->tagId);
+    }
+    else {
+        char mainClass[4];
+        memcpy(mainClass, dependency->mainClass, sizeof(mainClass));
+        zteam_deprotectClass(dependency->tagId, mainClass);
+    }
+}
+
+static void zteam_sweepRegion(const char *region, uint32_t size) {
+    const uint32_t *words = (const uint32_t *)region;
+    uint32_t wordCount = size / 4;
+    uint32_t i = 3; //words[i] is the tag ID of a Dependency starting at words[i - 3]
+#if defined(__SSE2__)
+    //nearly every word fails one of these, so only the rest are checked against the tag array
+    __m128i zero = _mm_setzero_si128();
+    __m128i indexMask = _mm_set1_epi32(0xFFFF);
+    __m128i indexLimit = _mm_set1_epi32((int)tagCount);
+    for(;i + 4 <= wordCount;i += 4) {
+        __m128i ids = _mm_loadu_si128((const __m128i *)(words + i));
+        __m128i zeroes = _mm_loadu_si128((const __m128i *)(words + i - 1));
+        __m128i candidates = _mm_and_si128(_mm_cmpeq_epi32(zeroes, zero), _mm_cmplt_epi32(_mm_and_si128(ids, indexMask), indexLimit));
+        candidates = _mm_andnot_si128(_mm_cmpeq_epi32(ids, zero), candidates);
+        int mask = _mm_movemask_ps(_mm_castsi128_ps(candidates));
+        for(uint32_t q=0;mask != 0;q++, mask >>= 1) {
+            if(mask & 1) zteam_sweepDependency((const Dependency *)(words + i + q - 3));
+        }
+    }
+#endif
+    for(;i<wordCount;i++) {
+        if(words[i] == 0 || words[i - 1] != 0 || (words[i] & 0xFFFF) >= tagCount) continue;
+        zteam_sweepDependency((const Dependency *)(words + i - 3));
+    }
+}
+
+static void zteam_sweepDependencies(MapData map, HaloMapIndex *index) {
+    TraceSpan span = traceBegin("zteam dependency sweep");
+    MapRegion regions[MAX_METADATA_REGIONS];
+    uint32_t regionCount = findMetadataRegions(map, regions);
+    uint32_t tagsStart = index->tagIndexOffset - magic;
+    uint32_t tagsEnd = tagsStart + tagCount * sizeof(MapTag);
+    for(uint32_t i=0;i<regionCount;i++) {
+        uint32_t start = regions[i].offset;
+        uint32_t end = regions[i].offset + regions[i].size;
+        if(tagsStart >= start && tagsEnd <= end) { //the tag array looks enough like Dependency blocks to recover tags from themselves
+            zteam_sweepRegion(map.buffer + start, tagsStart - start);
+            zteam_sweepRegion(map.buffer + tagsEnd, end - tagsEnd);
+        }
+        else {
+            zteam_sweepRegion(map.buffer + start, regions[i].size);
+        }
+    }
+    traceEnd(span);
+}
+
+static void zteam_deprotectInPlace(MapData new_map, ZTeamOptions options, MapTagIndex *sharedIndex);
+
+static void zteam_markCollection(uint32_t tag) { //collections are found by their class, which is why they count as reached
+    if(coverage && coverage->tags[tag] == TAG_COVERAGE_UNREACHED) coverage->tags[tag] = TAG_COVERAGE_COLLECTION;
+}
+
+MapData zteam_deprotect(MapData map) {
+    ZTeamOptions options;
+    options.sweepDependencies = false;
+    options.localityOrder = false;
+    return zteam_deprotectWithOptions(map, options);
+}
+
+MapData zteam_deprotectWithOptions(MapData map, ZTeamOptions options)
 {
-    MapData new_map;
-    
-    new_map.buffer = malloc(map.length);
-    new_map.length = map.length;
-    new_map.error = MAP_OK;
-    
+    MapData new_map = mapAllocate(map.length);
     memcpy(new_map.buffer,map.buffer,map.length);
-    
+    zteam_deprotectInPlace(new_map, options, NULL);
+    return new_map;
+}
+
+void zteam_deprotectWithIndex(MapData map, ZTeamOptions options, MapTagIndex *sharedIndex) {
+    zteam_deprotectInPlace(map, options, sharedIndex);
+}
+
+MapJournal zteam_deprotectJournal(MapData map, ZTeamOptions options) {
+    MapJournal changes;
+    mapJournalInit(&changes);
+    journal = &changes;
+    zteam_deprotectInPlace(map, options, NULL);
+    journal = NULL;
+    return changes;
+}
+
+MapCoverage zteam_coverage(MapData map, ZTeamOptions options) {
+    HaloMapHeader *header = (HaloMapHeader *)(map.buffer);
+    HaloMapIndex *index = (HaloMapIndex *)(map.buffer + header->indexOffset);
+    MapCoverage report;
+    memset(&report, 0, sizeof(report));
+    report.tagCount = index->tagCount;
+    report.tags = calloc(report.tagCount ? report.tagCount : 1, sizeof(uint8_t));
+    MapJournal changes;
+    mapJournalInit(&changes);
+    journal = &changes; //the map stays as it was
+    coverage = &report;
+    zteam_deprotectInPlace(map, options, NULL);
+    coverage = NULL;
+    journal = NULL;
+    freeMapJournal(&changes);
+    return report;
+}
+
+static void zteam_deprotectInPlace(MapData new_map, ZTeamOptions options, MapTagIndex *sharedIndex) //only writes through zteam_changeTagClass; a shared index must describe new_map, and its classes are kept up to date
+{
+    TraceSpan zteamSpan = traceBegin("zteam_deprotect");
     mapdata = new_map.buffer;
     uint32_t length = new_map.length;
     
     HaloMapHeader *header = ( HaloMapHeader *)(new_map.buffer);
     HaloMapIndex *index = ( HaloMapIndex *)(new_map.buffer + header->indexOffset);
     
-    magic = META_MEMORY_OFFSET - header->indexOffset;
+    magic = haloMapMagic(header);
     
     tagArray = ( MapTag *)(translatePointer(index->tagIndexOffset));
     tagCount = index->tagCount;
     
-    deprotectedTags = calloc(sizeof(bool) * tagCount,0x1);
+    deprotectedTags = deathstarCalloc(sizeof(bool) * tagCount);
+    recoveredTags = deathstarCalloc(sizeof(bool) * tagCount);
+    localityOrder = options.localityOrder;
     
-    haloCEmap = header->version == 609;
+    tagIndex = sharedIndex ? *sharedIndex : buildMapTagIndex(new_map);
     
     for(uint32_t i=0;i<tagCount;i++) {
-        deprotectedTags[i] = haloCEmap && tagArray[i].notInsideMap;
+        deprotectedTags[i] = (tagIndex.flags[i] & TAG_INDEX_EXTERNAL) != 0;
     }
     
     mapdataSize = length;
@@ -1117,17 +1685,19 @@ MapData zteam_deprotect(MapData map)
     matgTag.tableIndex = 0xFFFF;
     matgTag.tagTableIndex = 0xFFFF;
     
-    for(int i=0;i<tagCount;i++) {
-        char *name = translatePointer(tagArray[i].nameOffset);
-        uint32_t class = tagArray[i].classA;
-        if(class == *(uint32_t *)&MATG && strcmp(name,"globals\\globals") == 0) {
-            matgTag = tagArray[i].identity;
-            break;
-        }
+    uint32_t matgIndex = findFirstTagWithFlags(&tagIndex, TAG_INDEX_GLOBALS);
+    if(matgIndex < tagCount) {
+        matgTag = tagArray[matgIndex].identity;
     }
     if(!isNulledOut(matgTag)) {
         deprotectedTags[matgTag.tagTableIndex] = true;
     }
+    if(coverage) {
+        for(uint32_t i=0;i<tagCount;i++) {
+            coverage->tags[i] = deprotectedTags[i] ? TAG_COVERAGE_SKIPPED : TAG_COVERAGE_UNREACHED;
+        }
+    }
+    coverageSource = TAG_COVERAGE_GRAPH;
     
     MapTag scenarioTag = tagArray[index->scenarioTag.tagTableIndex];
     zteam_changeTagClass(index->scenarioTag, SCNR);
@@ -1135,6 +1705,7 @@ MapData zteam_deprotect(MapData map)
     
     ScnrDependencies scnrData = *( ScnrDependencies *)translatePointer(scenarioTag.dataOffset);
     
+    TraceSpan span = traceBegin("zteam object palettes");
     zteam_deprotectObjectPalette(scnrData.sceneryPalette);
     zteam_deprotectObjectPalette(scnrData.bipedPalette);
     zteam_deprotectObjectPalette(scnrData.equipPalette);
@@ -1157,10 +1728,16 @@ MapData zteam_deprotect(MapData map)
         zteam_deprotectSky(skies[i].sky.tagId);
     }
     
+    traceEnd(span);
+    
+    span = traceBegin("zteam BSPs");
     ScnrBSPs *bsps = ( ScnrBSPs *)translatePointer(scnrData.BSPs.offset);
     for(uint32_t i=0;i<scnrData.BSPs.count;i++) {
         zteam_deprotectSBSP(bsps[i].bsp.tagId, bsps[i].fileOffset, bsps[i].bspMagic);
     }
+    traceEnd(span);
+    
+    span = traceBegin("zteam scenario palettes");
     
     Dependency *decas = (Dependency *)translatePointer(scnrData.decalPalette.offset);
     for(uint32_t i=0;i<scnrData.decalPalette.count;i++) {
@@ -1176,7 +1753,9 @@ MapData zteam_deprotect(MapData map)
     for(uint32_t i=0;i<scnrData.netgameItmcs.count;i++) {
         zteam_deprotectItmc(itmcs[i].itemCollection.tagId);
     }
+    traceEnd(span);
     
+    span = traceBegin("zteam matg");
     if(!isNulledOut(matgTag)) {
         MatgDependencies matg = *( MatgDependencies *)(translatePointer(tagArray[matgTag.tagTableIndex].dataOffset));
         zteam_deprotectMatgObjectTagCollection(matg.weapons);
@@ -1252,23 +1831,221 @@ MapData zteam_deprotect(MapData map)
         
     }
     
-    for(uint32_t i=0;i<tagCount;i++) {
-        if(tagArray[i].classA == *(uint32_t *)&TAGC) {
-            TagReflexive tagc = *(TagReflexive *)translatePointer(tagArray[i].dataOffset);
-            Dependency *tags = translatePointer(tagc.offset);
-            zteam_deprotectDependencyArray(tags, tagc.count, NULL);
-        }
+    traceEnd(span);
+    
+    span = traceBegin("zteam tagc/Soul");
+    coverageSource = TAG_COVERAGE_COLLECTION;
+    uint32_t *collections = deathstarAlloc(sizeof(uint32_t) * tagCount);
+    uint32_t collectionCount = findTagsOfClass(&tagIndex, *(uint32_t *)&TAGC, collections);
+    for(uint32_t i=0;i<collectionCount;i++) {
+        zteam_markCollection(collections[i]);
+        TagReflexive tagc = *(TagReflexive *)translatePointer(tagArray[collections[i]].dataOffset);
+        Dependency *tags = translatePointer(tagc.offset);
+        zteam_deprotectDependencyArray(tags, tagc.count, NULL);
     }
     
-    for(uint32_t i=0;i<tagCount;i++) {
-        if(tagArray[i].classA == *(uint32_t *)&SOUL) {
-            TagReflexive Soul = *(TagReflexive *)translatePointer(tagArray[i].dataOffset);
-            Dependency *tags = translatePointer(Soul.offset);
-            zteam_deprotectDependencyArray(tags, Soul.count, NULL);
+    collectionCount = findTagsOfClass(&tagIndex, *(uint32_t *)&SOUL, collections);
+    for(uint32_t i=0;i<collectionCount;i++) {
+        zteam_markCollection(collections[i]);
+        TagReflexive Soul = *(TagReflexive *)translatePointer(tagArray[collections[i]].dataOffset);
+        Dependency *tags = translatePointer(Soul.offset);
+        zteam_deprotectDependencyArray(tags, Soul.count, NULL);
+    }
+    deathstarFree(collections);
+    traceEnd(span);
+    
+    if(options.sweepDependencies) {
+        coverageSource = TAG_COVERAGE_SWEEP;
+        zteam_sweepDependencies(new_map, index);
+    }
+    if(coverage) summarizeMapCoverage(coverage, tagIndex.classA);
+    
+    deathstarFree(recoveredTags);
+    recoveredTags = NULL;
+    deathstarFree(deprotectedTags);
+    if(!sharedIndex) freeMapTagIndex(&tagIndex);
+    
+    traceEnd(zteamSpan);
+}
+
+#define MAX_RESOLVER_HINTS 0x10
+
+struct TagClassResolver {
+    MapData map;
+    MapTag *tags;
+    uint32_t tagCount;
+    uint32_t magic;
+    TagID scenarioTag;
+    bool externalTags;           //the engine can store tags in bitmaps.map/sounds.map
+    uint32_t *classes; //0 until the tag has been resolved
+    bool *ambiguous;             //the references to the tag disagreed about its class
+    uint32_t *referenceStart;    //tagCount + 1 entries into referenceClasses; NULL until the first lookup needs references
+    uint32_t *referenceClasses;  //mainClass of each Dependency, grouped by the tag it points at
+};
+
+TagClassResolver *createTagClassResolver(MapData map) {
+    HaloMapHeader *header = (HaloMapHeader *)(map.buffer);
+    HaloMapIndex *index = (HaloMapIndex *)(map.buffer + header->indexOffset);
+    TagClassResolver *resolver = malloc(sizeof(TagClassResolver));
+    resolver->map = map;
+    resolver->magic = haloMapMagic(header);
+    resolver->tags = (MapTag *)(map.buffer + (index->tagIndexOffset - resolver->magic));
+    resolver->tagCount = index->tagCount;
+    resolver->scenarioTag = index->scenarioTag;
+    resolver->externalTags = haloEngineForVersion(header->version)->externalTags;
+    resolver->classes = calloc(index->tagCount, sizeof(uint32_t));
+    resolver->ambiguous = calloc(index->tagCount, sizeof(bool));
+    resolver->referenceStart = NULL;
+    resolver->referenceClasses = NULL;
+    return resolver;
+}
+
+void freeTagClassResolver(TagClassResolver *resolver) {
+    if(resolver == NULL) return;
+    free(resolver->classes);
+    free(resolver->ambiguous);
+    free(resolver->referenceStart);
+    free(resolver->referenceClasses);
+    free(resolver);
+}
+
+static void *resolver_translatePointer(const TagClassResolver *resolver, uint32_t pointer, uint32_t size) { //NULL if it leaves the map
+    uint32_t offset = pointer - resolver->magic;
+    if(offset > resolver->map.length || resolver->map.length - offset < size) return NULL;
+    return resolver->map.buffer + offset;
+}
+
+typedef struct {
+    uint32_t tagIndex;
+    uint32_t class;
+} ResolverReference;
+
+typedef struct {
+    ResolverReference *references;
+    uint32_t count;
+    uint32_t capacity;
+} ResolverReferences;
+
+static void resolver_findReferences(const TagClassResolver *resolver, const char *region, uint32_t size, ResolverReferences *found) { //every Dependency in the region that names a tag in the map
+    const uint32_t *words = (const uint32_t *)region;
+    uint32_t wordCount = size / 4;
+    for(uint32_t i=3;i<wordCount;i++) { //words[i] is the tag ID of a Dependency starting at words[i - 3]
+        if(words[i - 1] != 0 || (words[i] & 0xFFFF) >= resolver->tagCount) continue;
+        uint32_t tagIndex = words[i] & 0xFFFF;
+        if(tagIDValue(resolver->tags[tagIndex].identity) != words[i]) continue;
+        uint32_t class = words[i - 3];
+        if(!isHaloClass(class)) continue;
+        if(found->count == found->capacity) {
+            found->capacity = found->capacity ? found->capacity * 2 : 0x400;
+            found->references = realloc(found->references, found->capacity * sizeof(ResolverReference));
         }
+        found->references[found->count].tagIndex = tagIndex;
+        found->references[found->count].class = class;
+        found->count++;
+    }
+}
+
+static void resolver_buildReferences(TagClassResolver *resolver) { //one pass over the map, shared by every later lookup
+    TraceSpan span = traceBegin("resolver references");
+    ResolverReferences found = { NULL, 0, 0 };
+    MapRegion regions[MAX_METADATA_REGIONS];
+    uint32_t regionCount = findMetadataRegions(resolver->map, regions);
+    for(uint32_t i=0;i<regionCount;i++) {
+        resolver_findReferences(resolver, resolver->map.buffer + regions[i].offset, regions[i].size, &found);
     }
     
-    free(deprotectedTags);
+    //group them by tag, keeping the order they appear in the map
+    resolver->referenceStart = calloc(resolver->tagCount + 1, sizeof(uint32_t));
+    resolver->referenceClasses = malloc((found.count ? found.count : 1) * sizeof(uint32_t));
+    for(uint32_t i=0;i<found.count;i++) {
+        resolver->referenceStart[found.references[i].tagIndex + 1]++;
+    }
+    for(uint32_t i=0;i<resolver->tagCount;i++) {
+        resolver->referenceStart[i + 1] += resolver->referenceStart[i];
+    }
+    uint32_t *next = malloc((resolver->tagCount ? resolver->tagCount : 1) * sizeof(uint32_t));
+    memcpy(next, resolver->referenceStart, resolver->tagCount * sizeof(uint32_t));
+    for(uint32_t i=0;i<found.count;i++) {
+        resolver->referenceClasses[next[found.references[i].tagIndex]++] = found.references[i].class;
+    }
+    free(next);
+    free(found.references);
+    traceEnd(span);
+}
+
+static bool isObjectClass(uint32_t class) {
+    if(class == *(uint32_t *)&OBJE || class == *(uint32_t *)&UNIT || class == *(uint32_t *)&ITEM || class == *(uint32_t *)&DEVI) return true;
+    for(uint32_t i=0;i<sizeof(objectTypeClasses)/4;i++) {
+        if(class == *(uint32_t *)objectTypeClasses[i]) return true;
+    }
+    return false;
+}
+
+static bool isShaderClass(uint32_t class) {
+    for(uint32_t i=0;i<sizeof(shaderTypeClasses)/4;i++) {
+        if(class == *(uint32_t *)shaderTypeClasses[i]) return true;
+    }
+    return false;
+}
+
+static uint32_t resolver_refineClass(const TagClassResolver *resolver, const MapTag *tag, uint32_t class) { //same identification the walkers use for obje and shdr
+    if(isObjectClass(class)) {
+        ObjeDependencies *object = resolver_translatePointer(resolver, tag->dataOffset, sizeof(ObjeDependencies));
+        if(object == NULL) return class;
+        if(object->tagObjectType >= sizeof(objectTypeClasses) / 0x4) return *(uint32_t *)&OBJE;
+        return *(uint32_t *)objectTypeClasses[object->tagObjectType];
+    }
+    if(isShaderClass(class)) {
+        Shader *shdr = resolver_translatePointer(resolver, tag->dataOffset, sizeof(Shader));
+        if(shdr == NULL || shdr->type < 0x3 || shdr->type >= sizeof(shaderTypeClasses) / 0x4) return class;
+        return *(uint32_t *)shaderTypeClasses[shdr->type];
+    }
+    return class;
+}
+
+uint32_t zteam_resolveTagClass(TagClassResolver *resolver, uint32_t tagIndex) {
+    if(tagIndex >= resolver->tagCount) return 0;
+    if(resolver->classes[tagIndex] != 0) return resolver->classes[tagIndex];
     
-    return new_map;
-}
\ No newline at end of file
+    MapTag *tag = &resolver->tags[tagIndex];
+    uint32_t class = tag->classA;
+    
+    if(tagIndex == resolver->scenarioTag.tagTableIndex) {
+        class = *(uint32_t *)&SCNR;
+    }
+    else if(classCanBeDeprotected(class) && !(resolver->externalTags && tag->notInsideMap)) {
+        //only the Dependency blocks naming this tag matter; each one is a vote for its class
+        if(resolver->referenceStart == NULL) resolver_buildReferences(resolver);
+        uint32_t hints[MAX_RESOLVER_HINTS];
+        uint32_t votes[MAX_RESOLVER_HINTS];
+        uint32_t hintCount = 0;
+        for(uint32_t i=resolver->referenceStart[tagIndex];i<resolver->referenceStart[tagIndex + 1];i++) {
+            uint32_t refined = resolver_refineClass(resolver, tag, resolver->referenceClasses[i]);
+            uint32_t hint = 0;
+            while(hint < hintCount && hints[hint] != refined) hint++;
+            if(hint == hintCount) {
+                if(hintCount == MAX_RESOLVER_HINTS) continue;
+                hints[hintCount] = refined;
+                votes[hintCount++] = 0;
+            }
+            votes[hint]++;
+        }
+        
+        //a generic obje only wins if nothing more specific points at the tag
+        uint32_t best = hintCount;
+        for(uint32_t i=0;i<hintCount;i++) {
+            if(best != hintCount && hints[i] == *(uint32_t *)&OBJE) continue;
+            if(best == hintCount || votes[i] > votes[best] || hints[best] == *(uint32_t *)&OBJE) best = i;
+        }
+        if(best != hintCount) class = hints[best];
+        resolver->ambiguous[tagIndex] = hintCount > 1;
+    }
+    
+    resolver->classes[tagIndex] = class;
+    return class;
+}
+
+bool zteam_tagClassIsAmbiguous(TagClassResolver *resolver, uint32_t tagIndex) {
+    if(zteam_resolveTagClass(resolver, tagIndex) == 0) return false;
+    return resolver->ambiguous[tagIndex];
+}
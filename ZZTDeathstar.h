@@ -26,6 +26,12 @@
 #ifndef deathstar_ZZTDeathstar_h
 #define deathstar_ZZTDeathstar_h
 
+#if defined(__GNUC__)
+#define DEATHSTAR_API __attribute__((visibility("default"))) //the library is built with -fvisibility=hidden
+#else
+#define DEATHSTAR_API
+#endif
+
 typedef enum {
     MAP_OK,
     MAP_INVALID_PATH,
@@ -33,17 +39,59 @@ typedef enum {
     MAP_INVALID_INDEX_POINTER
 } MapError;
 
+typedef enum {
+    MAP_OWNED,                   //allocated by the library with malloc; mapClose frees it
+    MAP_ARENA,                   //allocated from the active arena; mapArenaReset releases it
+    MAP_BORROWED,                //the caller's buffer; mapClose leaves it alone
+    MAP_MAPPED                   //a memory-mapped file; mapClose unmaps it
+} MapOwnership;
+
 typedef struct {
     char *buffer;
     uint32_t length;
     MapError error;
+    MapOwnership ownership;
 } MapData;
 
 
-MapData openMapAtPath(const char *path);
-MapData openMapFromBuffer(void *buffer);
-int saveMap(const char *path, MapData map);
-MapData zteam_deprotect(MapData map);
-MapData name_deprotect(MapData map);
+DEATHSTAR_API MapData openMapAtPath(const char *path);
+DEATHSTAR_API MapData openMapFromBuffer(void *buffer); //borrowed; trusts the lengths in the header
+DEATHSTAR_API MapData openMapFromBufferWithLength(void *buffer, size_t length); //borrowed; checks the header, index and tag array fit in length
+DEATHSTAR_API MapData mapAllocate(uint32_t length); //uninitialized, owned by the active arena if there is one
+DEATHSTAR_API void mapClose(MapData *map);
+DEATHSTAR_API int saveMap(const char *path, MapData map);
+DEATHSTAR_API int saveMapReplacing(const char *path, MapData map); //writes a file beside path, then renames it over path, so path is never half written
+DEATHSTAR_API MapData openMapFromStream(FILE *stream); //reads to the end, so pipes work; owned
+DEATHSTAR_API MapData openMapFromDescriptor(int descriptor); //same, for a file descriptor the caller still owns
+DEATHSTAR_API int saveMapToStream(FILE *stream, MapData map); //flushes, but leaves the stream open
+DEATHSTAR_API int saveMapToDescriptor(int descriptor, MapData map);
+DEATHSTAR_API MapData zteam_deprotect(MapData map);
+
+typedef struct {
+    bool sweepDependencies;      //after the walkers, recover tags referenced from any Dependency block in the metadata, including fields the walkers don't know
+    bool localityOrder;          //visit the tags in each palette or dependency list in the order their data is stored, prefetching the next one
+} ZTeamOptions;
+
+DEATHSTAR_API MapData zteam_deprotectWithOptions(MapData map, ZTeamOptions options);
+DEATHSTAR_API MapData name_deprotect(MapData map);
+
+typedef enum {
+    NAME_LAYOUT_APPEND,          //new names go after the end of the map
+    NAME_LAYOUT_COMPACT          //reuse the original name region, appending only if the names don't fit
+} NameLayout;
+
+typedef struct {
+    NameLayout layout;
+    uint32_t threads;            //appended names are generated on this many threads; 0 or 1 uses the calling thread
+} NameDeprotectOptions;
+
+DEATHSTAR_API MapData name_deprotectWithOptions(MapData map, NameDeprotectOptions options);
+
+typedef struct TagClassResolver TagClassResolver;
+
+DEATHSTAR_API TagClassResolver *createTagClassResolver(MapData map);
+DEATHSTAR_API uint32_t zteam_resolveTagClass(TagClassResolver *resolver, uint32_t tagIndex); //the first lookup that needs references scans the whole map
+DEATHSTAR_API bool zteam_tagClassIsAmbiguous(TagClassResolver *resolver, uint32_t tagIndex); //the tags referencing it disagreed; the class most of them used was chosen
+DEATHSTAR_API void freeTagClassResolver(TagClassResolver *resolver);
 
 #endif
@@ -0,0 +1,259 @@
+// ZZTDiff.c
+
+/*
+ 
+ Copyright (c) 2014, Paul Whitcomb
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * Neither the name of Paul Whitcomb nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ 
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include "ZZTDiff.h"
+#include "ZZTTagData.h"
+#include "ZZTEngine.h"
+#include "ZZTMapIndex.h"
+#include "ZZTHash.h"
+#include "ZZTParallel.h"
+#include "ZZTArena.h"
+#include "ZZTTrace.h"
+
+typedef struct {
+    MapData map;
+    uint32_t metaMemoryOffset;
+    uint32_t magic;
+    MapTag *tags;
+    uint32_t tagCount;
+    MapRegion *regions;
+    uint64_t *hashes;
+} DiffSide;
+
+MapData openMapMappedAtPath(const char *path) {
+#ifdef _WIN32
+    return openMapAtPath(path);
+#else
+    MapData map;
+    map.buffer = NULL;
+    map.length = 0;
+    map.error = MAP_INVALID_PATH;
+    map.ownership = MAP_BORROWED;
+    int file = open(path, O_RDONLY);
+    if(file < 0) return map;
+    struct stat info;
+    HaloMapHeader header;
+    if(fstat(file, &info) != 0 || pread(file, &header, sizeof(header), 0) != (ssize_t)sizeof(header)) {
+        close(file);
+        map.error = MAP_INVALID_HEADER;
+        return map;
+    }
+    size_t length = header.length < (uint64_t)info.st_size ? header.length : (size_t)info.st_size; //the header can't make us read past the file
+    if(length < sizeof(header)) length = sizeof(header);
+    TraceSpan span = traceBegin("map file");
+    void *buffer = mmap(NULL, length, PROT_READ, MAP_PRIVATE, file, 0);
+    close(file);
+    traceEnd(span);
+    if(buffer == MAP_FAILED) return map;
+    map = openMapFromBufferWithLength(buffer, length);
+    map.ownership = MAP_MAPPED;
+    if(map.error != MAP_OK) {
+        map.length = (uint32_t)length;
+        mapClose(&map);
+    }
+    return map;
+#endif
+}
+
+static bool diff_openSide(DiffSide *side, MapData map) {
+    side->map = map;
+    if(map.length < sizeof(HaloMapHeader)) return false;
+    HaloMapHeader *header = (HaloMapHeader *)(map.buffer);
+    if(header->indexOffset > map.length || map.length - header->indexOffset < sizeof(HaloMapIndex)) return false;
+    HaloMapIndex *index = (HaloMapIndex *)(map.buffer + header->indexOffset);
+    side->metaMemoryOffset = haloMetaMemoryOffset(header);
+    side->magic = side->metaMemoryOffset - header->indexOffset;
+    uint32_t tagsOffset = index->tagIndexOffset - side->magic;
+    if(tagsOffset > map.length || (map.length - tagsOffset) / sizeof(MapTag) < index->tagCount) return false;
+    side->tags = (MapTag *)(map.buffer + tagsOffset);
+    side->tagCount = index->tagCount;
+    return true;
+}
+
+static uint64_t diff_hashRegion(const DiffSide *side, MapRegion region) {
+    if(region.size == 0 || region.offset > side->map.length || side->map.length - region.offset < region.size) return 0;
+    return hash64(side->map.buffer + region.offset, region.size, region.size);
+}
+
+static void diff_hashSlice(void *context, uint32_t start, uint32_t end) {
+    TraceSpan span = traceBegin("diff hash slice");
+    DiffSide *side = context;
+    for(uint32_t i=start;i<end;i++) {
+        //the size is part of the hash, so a tag that grew or shrank is changed even if it starts the same way
+        side->hashes[i] = diff_hashRegion(side, side->regions[i]);
+    }
+    traceEnd(span);
+}
+
+static void diff_findRegions(DiffSide *side) {
+    MapTagIndex index = buildMapTagIndex(side->map);
+    side->regions = deathstarAlloc(sizeof(MapRegion) * (side->tagCount + 1));
+    side->hashes = deathstarAlloc(sizeof(uint64_t) * (side->tagCount + 1));
+    findTagDataRegions(side->map, &index, side->regions);
+    freeMapTagIndex(&index);
+}
+
+static const char *diff_tagName(const DiffSide *side, uint32_t tag) {
+    uint32_t nameOffset = side->tags[tag].nameOffset - side->magic;
+    if(side->tags[tag].nameOffset < side->metaMemoryOffset || nameOffset >= side->map.length) return NULL;
+    const char *name = side->map.buffer + nameOffset;
+    return memchr(name, 0, side->map.length - nameOffset) ? name : NULL;
+}
+
+static bool diff_sameName(const char *oldName, const char *newName) {
+    if(oldName == NULL || newName == NULL) return oldName == newName;
+    return strcmp(oldName, newName) == 0;
+}
+
+static uint32_t diff_tagID(const DiffSide *side, uint32_t tag) {
+    uint32_t identity;
+    memcpy(&identity, &side->tags[tag].identity, sizeof(identity));
+    return identity;
+}
+
+typedef struct {
+    const char *name;
+    uint32_t tagClass;
+    uint32_t tag;
+} DiffKey;
+
+static int diff_compareKeys(const void *a, const void *b) { //tags with the same name and class stay in index order
+    const DiffKey *keyA = a;
+    const DiffKey *keyB = b;
+    if(keyA->tagClass != keyB->tagClass) return keyA->tagClass < keyB->tagClass ? -1 : 1;
+    int order = strcmp(keyA->name, keyB->name);
+    if(order != 0) return order;
+    return keyA->tag < keyB->tag ? -1 : keyA->tag > keyB->tag;
+}
+
+static uint32_t diff_namedKeys(const DiffSide *side, DiffKey *keys) {
+    uint32_t keyCount = 0;
+    for(uint32_t i=0;i<side->tagCount;i++) {
+        keys[keyCount].name = diff_tagName(side, i);
+        keys[keyCount].tagClass = side->tags[i].classA;
+        keys[keyCount].tag = i;
+        if(keys[keyCount].name) keyCount++;
+    }
+    qsort(keys, keyCount, sizeof(DiffKey), diff_compareKeys);
+    return keyCount;
+}
+
+static void diff_pairTags(const DiffSide *oldSide, const DiffSide *newSide, uint32_t *oldPairs, uint32_t *newPairs) { //UINT32_MAX for a tag with no partner
+    for(uint32_t i=0;i<oldSide->tagCount;i++) oldPairs[i] = UINT32_MAX;
+    for(uint32_t i=0;i<newSide->tagCount;i++) newPairs[i] = UINT32_MAX;
+    
+    //a tag that kept its name and class is the same tag, wherever it moved
+    DiffKey *oldKeys = deathstarAlloc(sizeof(DiffKey) * (oldSide->tagCount + 1));
+    DiffKey *newKeys = deathstarAlloc(sizeof(DiffKey) * (newSide->tagCount + 1));
+    uint32_t oldKeyCount = diff_namedKeys(oldSide, oldKeys);
+    uint32_t newKeyCount = diff_namedKeys(newSide, newKeys);
+    uint32_t o = 0, n = 0;
+    while(o < oldKeyCount && n < newKeyCount) {
+        DiffKey oldKey = oldKeys[o], newKey = newKeys[n];
+        oldKey.tag = newKey.tag = 0;
+        int order = diff_compareKeys(&oldKey, &newKey);
+        if(order < 0) o++;
+        else if(order > 0) n++;
+        else {
+            oldPairs[oldKeys[o].tag] = newKeys[n].tag;
+            newPairs[newKeys[n].tag] = oldKeys[o].tag;
+            o++;
+            n++;
+        }
+    }
+    deathstarFree(newKeys);
+    deathstarFree(oldKeys);
+    
+    //the rest were renamed, reclassified or never had a name, so their tag ID is all that ties them together
+    for(uint32_t i=0;i<oldSide->tagCount;i++) {
+        if(oldPairs[i] != UINT32_MAX) continue;
+        uint32_t identity = diff_tagID(oldSide, i);
+        uint32_t candidate = identity & 0xFFFF;
+        if(candidate >= newSide->tagCount || newPairs[candidate] != UINT32_MAX || diff_tagID(newSide, candidate) != identity) continue;
+        oldPairs[i] = candidate;
+        newPairs[candidate] = i;
+    }
+}
+
+MapDiff diffMaps(MapData oldMap, MapData newMap, uint32_t threads) {
+    MapDiff diff;
+    diff.tags = NULL;
+    diff.count = 0;
+    DiffSide oldSide, newSide;
+    if(!diff_openSide(&oldSide, oldMap) || !diff_openSide(&newSide, newMap)) return diff;
+    
+    diff_findRegions(&oldSide);
+    diff_findRegions(&newSide);
+    parallelFor(oldSide.tagCount, threads, diff_hashSlice, &oldSide);
+    parallelFor(newSide.tagCount, threads, diff_hashSlice, &newSide);
+    uint32_t *oldPairs = deathstarAlloc(sizeof(uint32_t) * (oldSide.tagCount + 1));
+    uint32_t *newPairs = deathstarAlloc(sizeof(uint32_t) * (newSide.tagCount + 1));
+    diff_pairTags(&oldSide, &newSide, oldPairs, newPairs);
+    
+    //old tags in order, paired or removed, then the new tags nothing was paired with
+    diff.tags = deathstarAlloc(sizeof(TagDiff) * (oldSide.tagCount + newSide.tagCount + 1));
+    for(uint32_t i=0;i<oldSide.tagCount + newSide.tagCount;i++) {
+        uint32_t oldTag = i < oldSide.tagCount ? i : UINT32_MAX;
+        uint32_t newTag = i < oldSide.tagCount ? oldPairs[i] : i - oldSide.tagCount;
+        if(oldTag == UINT32_MAX && newPairs[newTag] != UINT32_MAX) continue;
+        TagDiff entry;
+        memset(&entry, 0, sizeof(entry));
+        entry.oldTag = oldTag;
+        entry.newTag = newTag;
+        if(oldTag != UINT32_MAX) {
+            entry.oldClass = oldSide.tags[oldTag].classA;
+            entry.oldName = diff_tagName(&oldSide, oldTag);
+        }
+        if(newTag != UINT32_MAX) {
+            entry.newClass = newSide.tags[newTag].classA;
+            entry.newName = diff_tagName(&newSide, newTag);
+        }
+        if(oldTag == UINT32_MAX) entry.changes = TAG_DIFF_ADDED;
+        else if(newTag == UINT32_MAX) entry.changes = TAG_DIFF_REMOVED;
+        else {
+            if(entry.oldClass != entry.newClass) entry.changes |= TAG_DIFF_RECLASSIFIED;
+            if(!diff_sameName(entry.oldName, entry.newName)) entry.changes |= TAG_DIFF_RENAMED;
+            if(oldSide.hashes[oldTag] != newSide.hashes[newTag]) entry.changes |= TAG_DIFF_CHANGED;
+        }
+        if(entry.changes) diff.tags[diff.count++] = entry;
+    }
+    
+    deathstarFree(newPairs);
+    deathstarFree(oldPairs);
+    deathstarFree(oldSide.regions);
+    deathstarFree(oldSide.hashes);
+    deathstarFree(newSide.regions);
+    deathstarFree(newSide.hashes);
+    return diff;
+}
+
+void freeMapDiff(MapDiff *diff) {
+    deathstarFree(diff->tags);
+    diff->tags = NULL;
+    diff->count = 0;
+}
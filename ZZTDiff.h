@@ -0,0 +1,52 @@
+// ZZTDiff.h
+
+/*
+ 
+ Copyright (c) 2014, Paul Whitcomb
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * Neither the name of Paul Whitcomb nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ 
+ */
+
+#include "ZZTDeathstar.h"
+
+#ifndef deathstar_ZZTDiff_h
+#define deathstar_ZZTDiff_h
+
+typedef enum {
+    TAG_DIFF_ADDED        = 0x1,
+    TAG_DIFF_REMOVED      = 0x2,
+    TAG_DIFF_RECLASSIFIED = 0x4,
+    TAG_DIFF_RENAMED      = 0x8,
+    TAG_DIFF_CHANGED      = 0x10  //the tag's data is different
+} TagDiffFlags;
+
+typedef struct {
+    uint32_t oldTag;            //paired by name and class, then by tag ID; UINT32_MAX if the tag isn't in that map
+    uint32_t newTag;
+    uint32_t changes;           //TagDiffFlags
+    uint32_t oldClass;
+    uint32_t newClass;
+    const char *oldName;        //point into the maps; NULL if the tag or its name isn't there
+    const char *newName;
+} TagDiff;
+
+typedef struct {
+    TagDiff *tags;              //only the tags that changed
+    uint32_t count;
+} MapDiff;
+
+MapData openMapMappedAtPath(const char *path); //read-only view of the file; close it with mapClose
+MapDiff diffMaps(MapData oldMap, MapData newMap, uint32_t threads);
+void freeMapDiff(MapDiff *diff);
+
+#endif
@@ -0,0 +1,41 @@
+// ZZTEngine.c
+
+/*
+ 
+ Copyright (c) 2014, Paul Whitcomb
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * Neither the name of Paul Whitcomb nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ 
+ */
+
+#include "ZZTEngine.h"
+
+static const HaloEngineInfo haloEngines[HALO_ENGINE_COUNT] = {
+#define HALO_ENGINE_INFO(name, version, metaMemoryOffset, externalTags) { HALO_ENGINE_##name, version, metaMemoryOffset, externalTags },
+    HALO_ENGINES(HALO_ENGINE_INFO)
+#undef HALO_ENGINE_INFO
+};
+
+const HaloEngineInfo *haloEngineForVersion(uint32_t version) {
+    for(uint32_t i=0;i<HALO_ENGINE_COUNT;i++) {
+        if(haloEngines[i].version == version) return &haloEngines[i];
+    }
+    return &haloEngines[HALO_ENGINE_PC];
+}
+
+uint32_t haloMetaMemoryOffset(const HaloMapHeader *header) {
+    return haloEngineForVersion(header->version)->metaMemoryOffset;
+}
+
+uint32_t haloMapMagic(const HaloMapHeader *header) {
+    return haloMetaMemoryOffset(header) - header->indexOffset;
+}
@@ -0,0 +1,52 @@
+// ZZTEngine.h
+
+/*
+ 
+ Copyright (c) 2014, Paul Whitcomb
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * Neither the name of Paul Whitcomb nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ 
+ */
+
+#include "ZZTDeathstar.h"
+#include "ZZTTagData.h"
+
+#ifndef deathstar_ZZTEngine_h
+#define deathstar_ZZTEngine_h
+
+#define HALO_VERSION_PC 7
+#define HALO_VERSION_CE 609
+
+//ENGINE(name, header version, address the meta region is loaded at, whether tags can be stored in bitmaps.map/sounds.map)
+#define HALO_ENGINES(ENGINE) \
+    ENGINE(PC, HALO_VERSION_PC, 0x40440000, false) \
+    ENGINE(CE, HALO_VERSION_CE, 0x40440000, true)
+
+typedef enum {
+#define HALO_ENGINE_ENUM(name, version, metaMemoryOffset, externalTags) HALO_ENGINE_##name,
+    HALO_ENGINES(HALO_ENGINE_ENUM)
+#undef HALO_ENGINE_ENUM
+    HALO_ENGINE_COUNT
+} HaloEngine;
+
+typedef struct {
+    HaloEngine engine;
+    uint32_t version;
+    uint32_t metaMemoryOffset;
+    bool externalTags;
+} HaloEngineInfo;
+
+const HaloEngineInfo *haloEngineForVersion(uint32_t version); //other versions are treated as Halo PC
+uint32_t haloMetaMemoryOffset(const HaloMapHeader *header); //where the map's engine loads the meta region
+uint32_t haloMapMagic(const HaloMapHeader *header); //subtract from a meta pointer to get a file offset
+
+#endif
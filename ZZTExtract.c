@@ -0,0 +1,193 @@
+// ZZTExtract.c
+
+/*
+ 
+ Copyright (c) 2014, Paul Whitcomb
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * Neither the name of Paul Whitcomb nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ 
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <errno.h>
+#ifdef _WIN32
+#include <io.h>
+#include <direct.h>
+#define mkdir(path, mode) _mkdir(path)
+#define open(path, flags, mode) _open(path, (flags) | _O_BINARY, mode)
+#define write _write
+#define close _close
+#else
+#include <unistd.h>
+#endif
+#include "ZZTExtract.h"
+#include "ZZTTagData.h"
+#include "ZZTEngine.h"
+#include "ZZTTagClasses.h"
+#include "ZZTMapIndex.h"
+#include "ZZTParallel.h"
+#include "ZZTArena.h"
+#include "ZZTTrace.h"
+
+#define EXTRACT_PATH_LENGTH 0x400
+
+typedef struct {
+    MapData map;
+    const char *directory;
+    const MapRegion *regions;
+    const uint8_t *duplicate;
+    uint8_t *written;
+} ExtractJob;
+
+static bool isSafeTagName(const char *name) { //tag names come from the map, so keep them inside the output directory
+    if(name[0] == 0 || name[0] == '\\' || name[0] == '/' || strchr(name, ':')) return false;
+    for(const char *component = name; component; component = strpbrk(component, "\\/")) {
+        if(*component == '\\' || *component == '/') component++;
+        if(strncmp(component, "..", 2) == 0 && (component[2] == 0 || component[2] == '\\' || component[2] == '/')) return false;
+    }
+    return true;
+}
+
+static const char *extractTagName(MapData map, uint32_t tag, uint32_t *tagClass) { //NULL if the name isn't a safe, terminated string in the map
+    HaloMapHeader *header = (HaloMapHeader *)(map.buffer);
+    HaloMapIndex *index = (HaloMapIndex *)(map.buffer + header->indexOffset);
+    uint32_t magic = haloMapMagic(header);
+    MapTag *tags = (MapTag *)(map.buffer + (index->tagIndexOffset - magic));
+    if(tag >= index->tagCount) return NULL;
+    
+    uint32_t nameOffset = tags[tag].nameOffset - magic;
+    if(tags[tag].nameOffset < haloMetaMemoryOffset(header) || nameOffset >= map.length) return NULL;
+    const char *name = map.buffer + nameOffset;
+    if(memchr(name, 0, map.length - nameOffset) == NULL || !isSafeTagName(name)) return NULL;
+    *tagClass = tags[tag].classA;
+    return name;
+}
+
+static uint32_t formatTagPath(MapData map, uint32_t tag, bool duplicate, const char *directory, char *path, size_t pathSize) {
+    uint32_t tagClass;
+    const char *name = extractTagName(map, tag, &tagClass);
+    if(name == NULL) return 0;
+    
+    int length;
+    if(duplicate) { //another tag has the same name and class, so this one gets its index too
+        length = snprintf(path, pathSize, "%s/%s_%u.%s", directory, name, tag, translateHaloClassToExtension(tagClass));
+    }
+    else {
+        length = snprintf(path, pathSize, "%s/%s.%s", directory, name, translateHaloClassToExtension(tagClass));
+    }
+    if(length < 0 || (size_t)length >= pathSize) return 0;
+    for(char *character = path + strlen(directory); *character; character++) { //tag names use backslashes
+        if(*character == '\\') *character = '/';
+    }
+    return (uint32_t)length;
+}
+
+uint32_t extractTagPath(MapData map, uint32_t tag, const char *directory, char *path, size_t pathSize) {
+    return formatTagPath(map, tag, false, directory, path, pathSize);
+}
+
+typedef struct {
+    const char *name;
+    uint32_t tagClass;
+    uint32_t tag;
+} ExtractName;
+
+static int compareExtractNames(const void *a, const void *b) { //equal names end up together, lowest tag first
+    const ExtractName *nameA = a;
+    const ExtractName *nameB = b;
+    if(nameA->tagClass != nameB->tagClass) return nameA->tagClass < nameB->tagClass ? -1 : 1;
+    int order = strcmp(nameA->name, nameB->name);
+    if(order != 0) return order;
+    return nameA->tag < nameB->tag ? -1 : nameA->tag > nameB->tag;
+}
+
+static void findDuplicatePaths(MapData map, uint32_t tagCount, uint8_t *duplicate) {
+    ExtractName *names = deathstarAlloc(sizeof(ExtractName) * (tagCount + 1));
+    uint32_t nameCount = 0;
+    for(uint32_t i=0;i<tagCount;i++) {
+        duplicate[i] = 0;
+        names[nameCount].name = extractTagName(map, i, &names[nameCount].tagClass);
+        names[nameCount].tag = i;
+        if(names[nameCount].name) nameCount++;
+    }
+    qsort(names, nameCount, sizeof(ExtractName), compareExtractNames);
+    for(uint32_t i=1;i<nameCount;i++) {
+        if(names[i].tagClass == names[i - 1].tagClass && strcmp(names[i].name, names[i - 1].name) == 0) duplicate[names[i].tag] = 1;
+    }
+    deathstarFree(names);
+}
+
+static void makeParentDirectories(char *path) {
+    for(char *separator = strchr(path + 1, '/'); separator; separator = strchr(separator + 1, '/')) {
+        *separator = 0;
+        mkdir(path, 0777); //EEXIST is fine, including when another thread got there first
+        *separator = '/';
+    }
+}
+
+static bool writeTag(const char *path, const char *data, uint32_t size) { //straight from the map buffer
+    int file = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if(file < 0) return false;
+    while(size > 0) {
+        ssize_t written = write(file, data, size);
+        if(written < 0 && errno == EINTR) continue;
+        if(written <= 0) break;
+        data += written;
+        size -= (uint32_t)written;
+    }
+    return close(file) == 0 && size == 0;
+}
+
+static void extractSlice(void *context, uint32_t start, uint32_t end) {
+    TraceSpan span = traceBegin("extract slice");
+    ExtractJob *job = context;
+    char path[EXTRACT_PATH_LENGTH];
+    for(uint32_t i=start;i<end;i++) {
+        job->written[i] = 0;
+        if(job->regions[i].size == 0 || formatTagPath(job->map, i, job->duplicate[i], job->directory, path, sizeof(path)) == 0) continue;
+        makeParentDirectories(path);
+        job->written[i] = writeTag(path, job->map.buffer + job->regions[i].offset, job->regions[i].size);
+    }
+    traceEnd(span);
+}
+
+uint32_t extractTags(MapData map, const char *directory, uint32_t threads) {
+    MapTagIndex index = buildMapTagIndex(map);
+    
+    ExtractJob job;
+    job.map = map;
+    job.directory = directory;
+    MapRegion *regions = deathstarAlloc(sizeof(MapRegion) * (index.count + 1));
+    findTagDataRegions(map, &index, regions);
+    job.regions = regions;
+    job.written = deathstarAlloc(index.count + 1);
+    uint8_t *duplicate = deathstarAlloc(index.count + 1);
+    findDuplicatePaths(map, index.count, duplicate);
+    job.duplicate = duplicate;
+    
+    mkdir(directory, 0777);
+    parallelFor(index.count, threads, extractSlice, &job);
+    
+    uint32_t extracted = 0;
+    for(uint32_t i=0;i<index.count;i++) {
+        extracted += job.written[i];
+    }
+    deathstarFree(duplicate);
+    deathstarFree(job.written);
+    deathstarFree(regions);
+    freeMapTagIndex(&index);
+    return extracted;
+}
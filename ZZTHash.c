@@ -0,0 +1,108 @@
+// ZZTHash.c
+
+/*
+ 
+ Copyright (c) 2014, Paul Whitcomb
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * Neither the name of Paul Whitcomb nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ 
+ */
+
+#include <string.h>
+#include "ZZTHash.h"
+
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3 0x165667B19E3779F9ULL
+#define PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define PRIME64_5 0x27D4EB2F165667C5ULL
+
+static inline uint64_t rotl64(uint64_t value, int bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+static inline uint64_t read64(const unsigned char *data) {
+    uint64_t value;
+    memcpy(&value,data,8);
+    return value;
+}
+
+static inline uint32_t read32(const unsigned char *data) {
+    uint32_t value;
+    memcpy(&value,data,4);
+    return value;
+}
+
+static inline uint64_t hashRound(uint64_t accumulator, uint64_t input) {
+    accumulator += input * PRIME64_2;
+    accumulator = rotl64(accumulator, 31);
+    return accumulator * PRIME64_1;
+}
+
+static inline uint64_t hashMergeRound(uint64_t accumulator, uint64_t value) {
+    accumulator ^= hashRound(0, value);
+    return accumulator * PRIME64_1 + PRIME64_4;
+}
+
+uint64_t hash64(const void *data, size_t length, uint64_t seed) {
+    const unsigned char *bytes = data;
+    const unsigned char *end = bytes + length;
+    uint64_t hash;
+    
+    if(length >= 32) {
+        const unsigned char *limit = end - 32;
+        uint64_t v1 = seed + PRIME64_1 + PRIME64_2;
+        uint64_t v2 = seed + PRIME64_2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - PRIME64_1;
+        do {
+            v1 = hashRound(v1, read64(bytes));
+            v2 = hashRound(v2, read64(bytes + 8));
+            v3 = hashRound(v3, read64(bytes + 16));
+            v4 = hashRound(v4, read64(bytes + 24));
+            bytes += 32;
+        } while(bytes <= limit);
+        hash = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+        hash = hashMergeRound(hash, v1);
+        hash = hashMergeRound(hash, v2);
+        hash = hashMergeRound(hash, v3);
+        hash = hashMergeRound(hash, v4);
+    }
+    else {
+        hash = seed + PRIME64_5;
+    }
+    
+    hash += (uint64_t)length;
+    
+    while(bytes + 8 <= end) {
+        hash ^= hashRound(0, read64(bytes));
+        hash = rotl64(hash, 27) * PRIME64_1 + PRIME64_4;
+        bytes += 8;
+    }
+    if(bytes + 4 <= end) {
+        hash ^= (uint64_t)read32(bytes) * PRIME64_1;
+        hash = rotl64(hash, 23) * PRIME64_2 + PRIME64_3;
+        bytes += 4;
+    }
+    while(bytes < end) {
+        hash ^= (*bytes) * PRIME64_5;
+        hash = rotl64(hash, 11) * PRIME64_1;
+        bytes++;
+    }
+    
+    hash ^= hash >> 33;
+    hash *= PRIME64_2;
+    hash ^= hash >> 29;
+    hash *= PRIME64_3;
+    hash ^= hash >> 32;
+    return hash;
+}
@@ -0,0 +1,114 @@
+// ZZTJournal.c
+
+/*
+ 
+ Copyright (c) 2014, Paul Whitcomb
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * Neither the name of Paul Whitcomb nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ 
+ */
+
+#include <stddef.h>
+#include "ZZTJournal.h"
+#include "ZZTTagData.h"
+#include "ZZTEngine.h"
+
+void mapJournalInit(MapJournal *journal) {
+    journal->entries = NULL;
+    journal->count = 0;
+    journal->capacity = 0;
+    journal->incomplete = false;
+}
+
+bool mapJournalRecord(MapJournal *journal, uint32_t tag, MapJournalField field, uint32_t oldValue, uint32_t newValue) {
+    if(oldValue == newValue) return true;
+    if(journal->count == journal->capacity) {
+        uint32_t capacity = journal->capacity ? journal->capacity * 2 : 0x100;
+        MapJournalEntry *entries = realloc(journal->entries, sizeof(MapJournalEntry) * capacity);
+        if(entries == NULL) {
+            journal->incomplete = true;
+            return false;
+        }
+        journal->entries = entries;
+        journal->capacity = capacity;
+    }
+    MapJournalEntry *entry = &journal->entries[journal->count++];
+    entry->tag = tag;
+    entry->field = field;
+    entry->oldValue = oldValue;
+    entry->newValue = newValue;
+    return true;
+}
+
+uint32_t mapJournalOffset(MapData map, const MapJournalEntry *entry) {
+    HaloMapHeader *header = (HaloMapHeader *)(map.buffer);
+    HaloMapIndex *index = (HaloMapIndex *)(map.buffer + header->indexOffset);
+    uint32_t magic = haloMapMagic(header);
+    uint32_t tagsOffset = index->tagIndexOffset - magic;
+    return tagsOffset + entry->tag * sizeof(MapTag) + offsetof(MapTag, classA);
+}
+
+void mapJournalApply(MapData map, const MapJournal *journal) {
+    for(uint32_t i=0;i<journal->count;i++) {
+        uint32_t offset = mapJournalOffset(map, &journal->entries[i]);
+        memcpy(map.buffer + offset, &journal->entries[i].newValue, sizeof(uint32_t));
+    }
+}
+
+void mapJournalRevert(MapData map, const MapJournal *journal) {
+    for(uint32_t i=journal->count;i>0;i--) {
+        uint32_t offset = mapJournalOffset(map, &journal->entries[i - 1]);
+        memcpy(map.buffer + offset, &journal->entries[i - 1].oldValue, sizeof(uint32_t));
+    }
+}
+
+typedef struct {
+    MapJournalEntry entry;
+    uint32_t order;
+} JournalSortEntry;
+
+static int compareJournalEntries(const void *a, const void *b) {
+    const JournalSortEntry *left = a;
+    const JournalSortEntry *right = b;
+    if(left->entry.tag != right->entry.tag) return left->entry.tag < right->entry.tag ? -1 : 1;
+    if(left->entry.field != right->entry.field) return left->entry.field < right->entry.field ? -1 : 1;
+    return left->order < right->order ? -1 : (left->order > right->order);
+}
+
+void mapJournalCompact(MapJournal *journal) {
+    if(journal->count == 0) return;
+    JournalSortEntry *sorted = malloc(sizeof(JournalSortEntry) * journal->count);
+    if(sorted == NULL) return;
+    for(uint32_t i=0;i<journal->count;i++) {
+        sorted[i].entry = journal->entries[i];
+        sorted[i].order = i;
+    }
+    qsort(sorted, journal->count, sizeof(JournalSortEntry), compareJournalEntries);
+    uint32_t count = 0;
+    for(uint32_t i=0;i<journal->count;) {
+        MapJournalEntry merged = sorted[i].entry;
+        uint32_t next = i + 1;
+        while(next < journal->count && sorted[next].entry.tag == merged.tag && sorted[next].entry.field == merged.field) {
+            merged.newValue = sorted[next].entry.newValue;
+            next++;
+        }
+        if(merged.oldValue != merged.newValue) journal->entries[count++] = merged;
+        i = next;
+    }
+    journal->count = count;
+    free(sorted);
+}
+
+void freeMapJournal(MapJournal *journal) {
+    free(journal->entries);
+    mapJournalInit(journal);
+}
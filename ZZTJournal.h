@@ -0,0 +1,53 @@
+// ZZTJournal.h
+
+/*
+ 
+ Copyright (c) 2014, Paul Whitcomb
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * Neither the name of Paul Whitcomb nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ 
+ */
+
+#include "ZZTDeathstar.h"
+
+#ifndef deathstar_ZZTJournal_h
+#define deathstar_ZZTJournal_h
+
+typedef enum {
+    MAP_JOURNAL_TAG_CLASS        //classA in the tag array
+} MapJournalField;
+
+typedef struct {
+    uint32_t tag;                //index in the tag array
+    uint32_t field;              //MapJournalField
+    uint32_t oldValue;
+    uint32_t newValue;
+} MapJournalEntry;
+
+typedef struct {
+    MapJournalEntry *entries;    //in the order the changes were made
+    uint32_t count;
+    uint32_t capacity;
+    bool incomplete;             //a change couldn't be recorded, so the entries don't describe everything
+} MapJournal;
+
+DEATHSTAR_API void mapJournalInit(MapJournal *journal);
+DEATHSTAR_API bool mapJournalRecord(MapJournal *journal, uint32_t tag, MapJournalField field, uint32_t oldValue, uint32_t newValue); //false, and marks the journal incomplete, if there's no memory for the entry
+DEATHSTAR_API uint32_t mapJournalOffset(MapData map, const MapJournalEntry *entry); //where the field is in the file
+DEATHSTAR_API void mapJournalApply(MapData map, const MapJournal *journal); //redo, in place
+DEATHSTAR_API void mapJournalRevert(MapData map, const MapJournal *journal); //undo, in place
+DEATHSTAR_API void mapJournalCompact(MapJournal *journal); //one entry per changed field, in tag order
+DEATHSTAR_API void freeMapJournal(MapJournal *journal);
+
+DEATHSTAR_API MapJournal zteam_deprotectJournal(MapData map, ZTeamOptions options); //records what zteam_deprotectWithOptions would change, and leaves the map alone; check incomplete
+
+#endif
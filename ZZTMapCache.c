@@ -0,0 +1,137 @@
+// ZZTMapCache.c
+
+/*
+ 
+ Copyright (c) 2014, Paul Whitcomb
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * Neither the name of Paul Whitcomb nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ 
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#ifdef _WIN32
+#include <sys/utime.h>
+#include <direct.h>
+#define mkdir(path, mode) _mkdir(path)
+#else
+#include <utime.h>
+#include <unistd.h>
+#endif
+#include "ZZTMapCache.h"
+#include "ZZTHash.h"
+
+#define MAP_CACHE_SUFFIX ".map"
+#define MAP_CACHE_PATH_LENGTH 0x1000
+
+typedef struct {
+    char name[0x100];
+    uint64_t size;
+    time_t used;
+} MapCacheEntry;
+
+uint64_t hashMap(MapData map) {
+    return hash64(map.buffer, map.length, 0);
+}
+
+static void mapCachePath(char *path, MapCache cache, uint64_t hash, const char *operation) {
+    snprintf(path, MAP_CACHE_PATH_LENGTH, "%s/%016llx.%s%s", cache.directory, (unsigned long long)hash, operation, MAP_CACHE_SUFFIX);
+}
+
+MapData mapCacheLookup(MapCache cache, uint64_t hash, const char *operation) { //MAP_INVALID_PATH on a miss
+    char path[MAP_CACHE_PATH_LENGTH];
+    mapCachePath(path, cache, hash, operation);
+    MapData map = openMapAtPath(path);
+    if(map.error == MAP_OK) {
+        utime(path, NULL); //eviction goes by modification time, so a hit marks the entry as recently used
+    }
+    return map;
+}
+
+static bool isCacheEntryName(const char *name) { //only names mapCachePath makes: <16 hex digits>.<operation>.map
+    for(uint32_t i=0;i<16;i++) {
+        if(!((name[i] >= '0' && name[i] <= '9') || (name[i] >= 'a' && name[i] <= 'f'))) return false;
+    }
+    if(name[16] != '.') return false;
+    size_t operationLength = strlen(name + 17);
+    if(operationLength <= strlen(MAP_CACHE_SUFFIX) || strcmp(name + 17 + operationLength - strlen(MAP_CACHE_SUFFIX), MAP_CACHE_SUFFIX) != 0) return false;
+    operationLength -= strlen(MAP_CACHE_SUFFIX);
+    for(size_t i=0;i<operationLength;i++) {
+        char character = name[17 + i];
+        if(!((character >= 'a' && character <= 'z') || (character >= '0' && character <= '9') || character == '-')) return false;
+    }
+    return true;
+}
+
+static int compareCacheEntries(const void *a, const void *b) {
+    const MapCacheEntry *entryA = a;
+    const MapCacheEntry *entryB = b;
+    if(entryA->used < entryB->used) return -1;
+    if(entryA->used > entryB->used) return 1;
+    return strcmp(entryA->name, entryB->name);
+}
+
+static void mapCacheEvict(MapCache cache) {
+    DIR *directory = opendir(cache.directory);
+    if(directory == NULL) return;
+    
+    uint32_t entryCount = 0;
+    uint32_t entryCapacity = 0x40;
+    MapCacheEntry *entries = malloc(sizeof(MapCacheEntry) * entryCapacity);
+    uint64_t totalSize = 0;
+    char path[MAP_CACHE_PATH_LENGTH];
+    
+    struct dirent *file;
+    while((file = readdir(directory)) != NULL) {
+        //anything else in the directory, like maps kept beside the cache, is never counted or removed
+        if(strlen(file->d_name) >= sizeof(entries[0].name) || !isCacheEntryName(file->d_name)) continue;
+        
+        struct stat info;
+        snprintf(path, sizeof(path), "%s/%s", cache.directory, file->d_name);
+        if(stat(path, &info) != 0) continue;
+        
+        if(entryCount == entryCapacity) {
+            entryCapacity *= 2;
+            entries = realloc(entries, sizeof(MapCacheEntry) * entryCapacity);
+        }
+        strcpy(entries[entryCount].name, file->d_name);
+        entries[entryCount].size = (uint64_t)info.st_size;
+        entries[entryCount].used = info.st_mtime;
+        totalSize += entries[entryCount].size;
+        entryCount++;
+    }
+    closedir(directory);
+    
+    qsort(entries, entryCount, sizeof(MapCacheEntry), compareCacheEntries);
+    for(uint32_t i=0;i<entryCount && totalSize > cache.maxBytes;i++) {
+        snprintf(path, sizeof(path), "%s/%s", cache.directory, entries[i].name);
+        if(remove(path) == 0) {
+            totalSize -= entries[i].size;
+        }
+    }
+    free(entries);
+}
+
+int mapCacheStore(MapCache cache, uint64_t hash, const char *operation, MapData map) {
+    if(map.length > cache.maxBytes) return 1;
+    
+    char path[MAP_CACHE_PATH_LENGTH];
+    mapCachePath(path, cache, hash, operation);
+    
+    mkdir(cache.directory, 0755);
+    if(saveMapReplacing(path, map) != 0) return 1; //each store gets its own temporary file, so threads storing at once can't mix
+    mapCacheEvict(cache);
+    return 0;
+}
@@ -0,0 +1,220 @@
+// ZZTMapIndex.c
+
+/*
+ 
+ Copyright (c) 2014, Paul Whitcomb
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * Neither the name of Paul Whitcomb nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ 
+ */
+
+#include "ZZTMapIndex.h"
+#include "ZZTTagData.h"
+#include "ZZTArena.h"
+#include "ZZTEngine.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+//the engine's constants are passed as literals, so each specialization below has no version checks in its loop
+static inline void buildMapTagIndexColumns(MapTagIndex *tagIndex, const MapTag *tags, const char *buffer, uint32_t indexOffset, uint32_t metaSize, uint32_t metaMemoryOffset, bool externalTags) {
+    uint32_t magic = metaMemoryOffset - indexOffset;
+    for(uint32_t i=0;i<tagIndex->count;i++) {
+        uint8_t flags = 0;
+        tagIndex->classA[i] = tags[i].classA;
+        tagIndex->dataOffset[i] = tags[i].dataOffset;
+        tagIndex->nameOffset[i] = tags[i].nameOffset;
+        if(externalTags && tags[i].notInsideMap) {
+            flags |= TAG_INDEX_EXTERNAL;
+        }
+        if(!(tags[i].nameOffset < metaMemoryOffset || tags[i].nameOffset > metaMemoryOffset + metaSize)) {
+            const char *name = buffer + (tags[i].nameOffset - magic);
+            flags |= TAG_INDEX_NAME_IN_MAP;
+            if(strncmp(name,"ui\\",3) == 0 || strncmp(name,"sound\\",6) == 0) {
+                flags |= TAG_INDEX_SHARED_NAME;
+            }
+            else if(tags[i].classA == *(uint32_t *)&MATG && strcmp(name,"globals\\globals") == 0) {
+                flags |= TAG_INDEX_GLOBALS;
+            }
+        }
+        tagIndex->flags[i] = flags;
+    }
+}
+
+typedef void (*MapTagIndexBuilder)(MapTagIndex *tagIndex, const MapTag *tags, const char *buffer, uint32_t indexOffset, uint32_t metaSize);
+
+#define MAP_TAG_INDEX_BUILDER(name, version, metaMemoryOffset, externalTags) \
+static void buildMapTagIndexColumns##name(MapTagIndex *tagIndex, const MapTag *tags, const char *buffer, uint32_t indexOffset, uint32_t metaSize) { \
+    buildMapTagIndexColumns(tagIndex, tags, buffer, indexOffset, metaSize, metaMemoryOffset, externalTags); \
+}
+HALO_ENGINES(MAP_TAG_INDEX_BUILDER)
+#undef MAP_TAG_INDEX_BUILDER
+
+static const MapTagIndexBuilder mapTagIndexBuilders[HALO_ENGINE_COUNT] = {
+#define MAP_TAG_INDEX_BUILDER(name, version, metaMemoryOffset, externalTags) buildMapTagIndexColumns##name,
+    HALO_ENGINES(MAP_TAG_INDEX_BUILDER)
+#undef MAP_TAG_INDEX_BUILDER
+};
+
+MapTagIndex buildMapTagIndex(MapData map) {
+    HaloMapHeader *header = (HaloMapHeader *)(map.buffer);
+    HaloMapIndex *index = (HaloMapIndex *)(map.buffer + header->indexOffset);
+    const HaloEngineInfo *engine = haloEngineForVersion(header->version);
+    uint32_t magic = engine->metaMemoryOffset - header->indexOffset;
+    MapTag *tags = (MapTag *)(map.buffer + (index->tagIndexOffset - magic));
+    
+    MapTagIndex tagIndex;
+    tagIndex.count = index->tagCount;
+    
+    //one allocation for every column; flags go last so the uint32_t columns stay aligned
+    char *columns = deathstarAlloc((sizeof(uint32_t) * 3 + sizeof(uint8_t)) * tagIndex.count + 1);
+    tagIndex.classA = (uint32_t *)columns;
+    tagIndex.dataOffset = tagIndex.classA + tagIndex.count;
+    tagIndex.nameOffset = tagIndex.dataOffset + tagIndex.count;
+    tagIndex.flags = (uint8_t *)(tagIndex.nameOffset + tagIndex.count);
+    
+    mapTagIndexBuilders[engine->engine](&tagIndex, tags, map.buffer, header->indexOffset, header->metaSize);
+    return tagIndex;
+}
+
+void freeMapTagIndex(MapTagIndex *index) {
+    deathstarFree(index->classA);
+    index->classA = NULL;
+    index->dataOffset = NULL;
+    index->nameOffset = NULL;
+    index->flags = NULL;
+    index->count = 0;
+}
+
+uint32_t findTagsOfClass(const MapTagIndex *index, uint32_t tagClass, uint32_t *results) { //results must hold index->count entries
+    uint32_t found = 0;
+    uint32_t i = 0;
+#if defined(__SSE2__)
+    __m128i needle = _mm_set1_epi32((int)tagClass);
+    for(;i + 16 <= index->count;i += 16) {
+        const __m128i *classes = (const __m128i *)(index->classA + i);
+        __m128i match0 = _mm_cmpeq_epi32(_mm_loadu_si128(classes), needle);
+        __m128i match1 = _mm_cmpeq_epi32(_mm_loadu_si128(classes + 1), needle);
+        __m128i match2 = _mm_cmpeq_epi32(_mm_loadu_si128(classes + 2), needle);
+        __m128i match3 = _mm_cmpeq_epi32(_mm_loadu_si128(classes + 3), needle);
+        __m128i any = _mm_or_si128(_mm_or_si128(match0, match1), _mm_or_si128(match2, match3));
+        if(_mm_movemask_epi8(any) == 0) continue; //most blocks of 16 tags have no match
+        int mask = _mm_movemask_ps(_mm_castsi128_ps(match0))
+                 | _mm_movemask_ps(_mm_castsi128_ps(match1)) << 4
+                 | _mm_movemask_ps(_mm_castsi128_ps(match2)) << 8
+                 | _mm_movemask_ps(_mm_castsi128_ps(match3)) << 12;
+        for(uint32_t bit=0;bit<16;bit++) {
+            if(mask & (1 << bit)) results[found++] = i + bit;
+        }
+    }
+#endif
+    for(;i<index->count;i++) {
+        if(index->classA[i] == tagClass) results[found++] = i;
+    }
+    return found;
+}
+
+uint32_t findFirstTagWithFlags(const MapTagIndex *index, uint8_t flags) { //returns index->count if no tag has every flag
+    for(uint32_t i=0;i<index->count;i++) {
+        if((index->flags[i] & flags) == flags) return i;
+    }
+    return index->count;
+}
+
+static bool clampRegion(MapData map, uint32_t offset, uint32_t size, MapRegion *region) {
+    if(offset >= map.length) return false;
+    region->offset = offset;
+    region->size = map.length - offset < size ? map.length - offset : size;
+    return true;
+}
+
+uint32_t findMetadataRegions(MapData map, MapRegion *regions) {
+    HaloMapHeader *header = (HaloMapHeader *)(map.buffer);
+    uint32_t regionCount = 0;
+    if(!clampRegion(map, header->indexOffset, header->metaSize, &regions[regionCount])) return 0;
+    regionCount++;
+    
+    HaloMapIndex *index = (HaloMapIndex *)(map.buffer + header->indexOffset);
+    uint32_t magic = haloMapMagic(header);
+    uint32_t tagsOffset = index->tagIndexOffset - magic;
+    if(index->scenarioTag.tagTableIndex >= index->tagCount || tagsOffset > map.length || (map.length - tagsOffset) / sizeof(MapTag) <= index->scenarioTag.tagTableIndex) return regionCount;
+    
+    MapTag *scenario = (MapTag *)(map.buffer + tagsOffset) + index->scenarioTag.tagTableIndex;
+    uint32_t scenarioOffset = scenario->dataOffset - magic;
+    if(scenarioOffset > map.length || map.length - scenarioOffset < sizeof(ScnrDependencies)) return regionCount;
+    
+    ScnrDependencies *scnr = (ScnrDependencies *)(map.buffer + scenarioOffset);
+    uint32_t bspsOffset = scnr->BSPs.offset - magic;
+    if(bspsOffset > map.length || (map.length - bspsOffset) / sizeof(ScnrBSPs) < scnr->BSPs.count) return regionCount;
+    
+    ScnrBSPs *bsps = (ScnrBSPs *)(map.buffer + bspsOffset);
+    for(uint32_t i=0;i<scnr->BSPs.count && regionCount < MAX_METADATA_REGIONS;i++) { //BSP metadata lives outside the tag data
+        if(clampRegion(map, bsps[i].fileOffset, bsps[i].tagSize, &regions[regionCount])) regionCount++;
+    }
+    return regionCount;
+}
+
+static int compareOffsets(const void *a, const void *b) {
+    uint32_t offsetA = *(const uint32_t *)a;
+    uint32_t offsetB = *(const uint32_t *)b;
+    return offsetA < offsetB ? -1 : offsetA > offsetB;
+}
+
+void findTagDataRegions(MapData map, const MapTagIndex *index, MapRegion *regions) {
+    HaloMapHeader *header = (HaloMapHeader *)(map.buffer);
+    HaloMapIndex *mapIndex = (HaloMapIndex *)(map.buffer + header->indexOffset);
+    uint32_t magic = haloMapMagic(header);
+    MapRegion meta = {0, 0};
+    if(!clampRegion(map, header->indexOffset, header->metaSize, &meta)) meta.size = 0;
+    uint32_t metaEnd = meta.offset + meta.size;
+    
+    //the map doesn't store how big a tag is, so every tag runs until the next thing known to start after it
+    uint32_t *boundaries = deathstarAlloc(sizeof(uint32_t) * (index->count * 2 + 2));
+    uint32_t boundaryCount = 0;
+    boundaries[boundaryCount++] = mapIndex->tagIndexOffset - magic;
+    boundaries[boundaryCount++] = metaEnd;
+    for(uint32_t i=0;i<index->count;i++) {
+        if(!(index->flags[i] & TAG_INDEX_EXTERNAL)) boundaries[boundaryCount++] = index->dataOffset[i] - magic;
+        if(index->flags[i] & TAG_INDEX_NAME_IN_MAP) boundaries[boundaryCount++] = index->nameOffset[i] - magic;
+    }
+    qsort(boundaries, boundaryCount, sizeof(uint32_t), compareOffsets);
+    
+    for(uint32_t i=0;i<index->count;i++) {
+        uint32_t start = index->dataOffset[i] - magic;
+        regions[i].offset = start;
+        regions[i].size = 0;
+        if((index->flags[i] & TAG_INDEX_EXTERNAL) || start < meta.offset || start >= metaEnd) continue;
+        uint32_t low = 0, high = boundaryCount; //first boundary past start
+        while(low < high) {
+            uint32_t middle = (low + high) / 2;
+            if(boundaries[middle] <= start) low = middle + 1;
+            else high = middle;
+        }
+        regions[i].size = (low < boundaryCount ? boundaries[low] : metaEnd) - start;
+    }
+    deathstarFree(boundaries);
+    
+    //BSPs are stored apart from the other tags, and the scenario knows where
+    uint32_t tagsOffset = mapIndex->tagIndexOffset - magic;
+    if(mapIndex->scenarioTag.tagTableIndex >= index->count || tagsOffset > map.length || (map.length - tagsOffset) / sizeof(MapTag) <= mapIndex->scenarioTag.tagTableIndex) return;
+    uint32_t scenarioOffset = index->dataOffset[mapIndex->scenarioTag.tagTableIndex] - magic;
+    if(scenarioOffset > map.length || map.length - scenarioOffset < sizeof(ScnrDependencies)) return;
+    ScnrDependencies *scnr = (ScnrDependencies *)(map.buffer + scenarioOffset);
+    uint32_t bspsOffset = scnr->BSPs.offset - magic;
+    if(bspsOffset > map.length || (map.length - bspsOffset) / sizeof(ScnrBSPs) < scnr->BSPs.count) return;
+    ScnrBSPs *bsps = (ScnrBSPs *)(map.buffer + bspsOffset);
+    for(uint32_t i=0;i<scnr->BSPs.count;i++) {
+        uint32_t tag = bsps[i].bsp.tagId.tagTableIndex;
+        if(tag < index->count) clampRegion(map, bsps[i].fileOffset, bsps[i].tagSize, &regions[tag]);
+    }
+}
@@ -0,0 +1,54 @@
+// ZZTMapIndex.h
+
+/*
+ 
+ Copyright (c) 2014, Paul Whitcomb
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * Neither the name of Paul Whitcomb nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ 
+ */
+
+#include "ZZTDeathstar.h"
+
+#ifndef deathstar_ZZTMapIndex_h
+#define deathstar_ZZTMapIndex_h
+
+typedef enum {
+    TAG_INDEX_EXTERNAL    = 0x1, //Halo CE tag stored in bitmaps.map/sounds.map
+    TAG_INDEX_NAME_IN_MAP = 0x2, //nameOffset points inside the meta region
+    TAG_INDEX_SHARED_NAME = 0x4, //ui\ or sound\ tag; name deprotection keeps these
+    TAG_INDEX_GLOBALS     = 0x8  //matg tag named globals\globals
+} MapTagIndexFlags;
+
+typedef struct {
+    uint32_t count;
+    uint32_t *classA;
+    uint32_t *dataOffset;
+    uint32_t *nameOffset;
+    uint8_t *flags;
+} MapTagIndex; //structure-of-arrays copy of the MapTag array
+
+typedef struct {
+    uint32_t offset;
+    uint32_t size;
+} MapRegion; //file offsets
+
+#define MAX_METADATA_REGIONS 0x40
+
+MapTagIndex buildMapTagIndex(MapData map);
+void freeMapTagIndex(MapTagIndex *index);
+uint32_t findTagsOfClass(const MapTagIndex *index, uint32_t tagClass, uint32_t *results);
+uint32_t findFirstTagWithFlags(const MapTagIndex *index, uint8_t flags);
+uint32_t findMetadataRegions(MapData map, MapRegion *regions); //tag data first, then each BSP; up to MAX_METADATA_REGIONS
+void findTagDataRegions(MapData map, const MapTagIndex *index, MapRegion *regions); //one per tag; size is 0 if the tag isn't in the map
+
+#endif
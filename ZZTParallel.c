@@ -0,0 +1,86 @@
+// ZZTParallel.c
+
+/*
+ 
+ Copyright (c) 2014, Paul Whitcomb
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * Neither the name of Paul Whitcomb nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ 
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <pthread.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+#include "ZZTParallel.h"
+#include "ZZTArena.h"
+#include "ZZTTrace.h"
+
+typedef struct {
+    ParallelTask task;
+    void *context;
+    uint32_t start;
+    uint32_t end;
+    const char *map;        //trace label of the thread that asked for the work
+} ParallelSlice;
+
+uint32_t processorCount(void) {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors ? info.dwNumberOfProcessors : 1;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (uint32_t)count : 1;
+#endif
+}
+
+static void *parallelRunSlice(void *slice) {
+    ParallelSlice *work = slice;
+    traceSetMap(work->map);
+    work->task(work->context, work->start, work->end);
+    return NULL;
+}
+
+void parallelFor(uint32_t count, uint32_t threads, ParallelTask task, void *context) {
+    if(threads > count) threads = count;
+    if(threads <= 1) {
+        if(count) task(context, 0, count);
+        return;
+    }
+    
+    ParallelSlice *slices = deathstarAlloc(sizeof(ParallelSlice) * threads);
+    pthread_t *workers = deathstarAlloc(sizeof(pthread_t) * threads);
+    bool *started = deathstarAlloc(sizeof(bool) * threads);
+    for(uint32_t i=0;i<threads;i++) {
+        slices[i].task = task;
+        slices[i].context = context;
+        slices[i].start = (uint32_t)((uint64_t)count * i / threads);
+        slices[i].end = (uint32_t)((uint64_t)count * (i + 1) / threads);
+        slices[i].map = traceMapName();
+    }
+    for(uint32_t i=1;i<threads;i++) { //the calling thread takes the first slice
+        started[i] = pthread_create(&workers[i], NULL, parallelRunSlice, &slices[i]) == 0;
+    }
+    parallelRunSlice(&slices[0]);
+    for(uint32_t i=1;i<threads;i++) {
+        if(started[i]) pthread_join(workers[i], NULL);
+        else parallelRunSlice(&slices[i]); //out of threads, so do it here
+    }
+    deathstarFree(started);
+    deathstarFree(workers);
+    deathstarFree(slices);
+}
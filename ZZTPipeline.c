@@ -0,0 +1,174 @@
+// ZZTPipeline.c
+
+/*
+ 
+ Copyright (c) 2014, Paul Whitcomb
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * Neither the name of Paul Whitcomb nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ 
+ */
+
+#include "ZZTPipeline.h"
+#include "ZZTStrip.h"
+#include "ZZTChecksum.h"
+#include "ZZTTrace.h"
+#include "ZZTParallel.h"
+
+#define MAP_PART_METADATA (MAP_PART_TAG_CLASSES | MAP_PART_TAG_NAMES | MAP_PART_TAG_DATA | MAP_PART_LAYOUT)
+
+static void pipeline_replaceMap(MapPipeline *pipeline, MapData map) {
+    mapClose(&pipeline->map);
+    pipeline->map = map;
+}
+
+static bool pass_zteam(MapPipeline *pipeline) {
+    zteam_deprotectWithIndex(pipeline->map, pipeline->zteam, &pipeline->tagIndex);
+    return true;
+}
+
+static bool pass_name(MapPipeline *pipeline) {
+    pipeline_replaceMap(pipeline, name_deprotectWithIndex(pipeline->map, pipeline->names, &pipeline->tagIndex));
+    return true;
+}
+
+static bool pass_merge(MapPipeline *pipeline) {
+    MergeReport report;
+    pipeline_replaceMap(pipeline, mergeDuplicateTags(pipeline->map, &report));
+    pipeline->mergedTags += report.mergedTags;
+    return true;
+}
+
+static bool pass_strip(MapPipeline *pipeline) { //a map that can't be stripped is kept as it is
+    StripReport report;
+    MapData stripped = stripDeadTags(pipeline->map, &report);
+    if(report.result == STRIP_OK) {
+        pipeline_replaceMap(pipeline, stripped);
+        pipeline->removedTags += report.removedTags;
+    }
+    else {
+        mapClose(&stripped);
+    }
+    return true;
+}
+
+static bool pass_checksum(MapPipeline *pipeline) {
+    pipeline->checksum = updateMapChecksum(pipeline->map);
+    return true;
+}
+
+static bool pass_save(MapPipeline *pipeline) {
+    if(pipeline->saveDescriptor != -1) return saveMapToDescriptor(pipeline->saveDescriptor, pipeline->map) == 0;
+    return pipeline->savePath && saveMap(pipeline->savePath, pipeline->map) == 0;
+}
+
+static const MapPass mapPasses[] = {
+    { "zteam", MAP_PART_HEADER | MAP_PART_TAG_CLASSES | MAP_PART_TAG_DATA | MAP_PART_TAG_INDEX, MAP_PART_TAG_CLASSES | MAP_PART_TAG_INDEX, true, pass_zteam },
+    { "name", MAP_PART_HEADER | MAP_PART_TAG_CLASSES | MAP_PART_TAG_NAMES | MAP_PART_TAG_INDEX, MAP_PART_HEADER | MAP_PART_TAG_NAMES | MAP_PART_LAYOUT, false, pass_name },
+    { "merge", MAP_PART_HEADER | MAP_PART_METADATA, MAP_PART_TAG_DATA | MAP_PART_LAYOUT, true, pass_merge },
+    { "strip", MAP_PART_HEADER | MAP_PART_METADATA, MAP_PART_HEADER | MAP_PART_LAYOUT, true, pass_strip },
+    { "checksum", MAP_PART_METADATA, MAP_PART_HEADER, true, pass_checksum },
+    { "save", MAP_PART_HEADER | MAP_PART_METADATA, 0, true, pass_save }
+};
+
+const MapPass *findMapPass(const char *name) {
+    for(uint32_t i=0;i<sizeof(mapPasses) / sizeof(*mapPasses);i++) {
+        if(strcmp(mapPasses[i].name, name) == 0) return &mapPasses[i];
+    }
+    return NULL;
+}
+
+const char *parseMapPasses(const char *list, const MapPass **passes, uint32_t *count) {
+    static THREAD_LOCAL char error[0x60];
+    char name[0x20];
+    *count = 0;
+    while(*list) {
+        size_t length = strcspn(list, ",");
+        if(*count == MAX_MAP_PASSES) {
+            snprintf(error, sizeof(error), "At most %d passes can be run at once.", MAX_MAP_PASSES);
+            return error;
+        }
+        if(length >= sizeof(name)) {
+            snprintf(error, sizeof(error), "There is no pass called %.*s...", (int)(sizeof(name) - 1), list);
+            return error;
+        }
+        memcpy(name, list, length);
+        name[length] = 0;
+        passes[*count] = findMapPass(name);
+        if(passes[*count] == NULL) {
+            snprintf(error, sizeof(error), "There is no pass called %s.", name);
+            return error;
+        }
+        (*count)++;
+        list += length;
+        if(*list == ',') list++;
+    }
+    return NULL;
+}
+
+void mapPipelineInit(MapPipeline *pipeline, MapData map) {
+    memset(pipeline, 0, sizeof(*pipeline));
+    pipeline->map = map;
+    pipeline->names.layout = NAME_LAYOUT_APPEND;
+    pipeline->names.threads = 1;
+    pipeline->saveDescriptor = -1;
+}
+
+static bool pipeline_canSkip(const MapPass *const *passes, uint32_t current) { //nothing it reads has changed since the same pass last ran
+    if(!passes[current]->repeatable) return false;
+    uint32_t written = 0; //by the passes in between; a repeatable pass's own writes don't give it anything new to do
+    for(uint32_t i=current;i>0;i--) {
+        if(passes[i - 1] == passes[current]) return (written & passes[current]->reads) == 0;
+        written |= passes[i - 1]->writes;
+    }
+    return false;
+}
+
+const MapPass *runMapPipeline(MapPipeline *pipeline, const MapPass *const *passes, uint32_t count) {
+    for(uint32_t i=0;i<count;i++) {
+        const MapPass *pass = passes[i];
+        if(pipeline_canSkip(passes, i)) {
+            pipeline->skipped++;
+            continue;
+        }
+        
+        //only passes that change the buffer in place need one of their own
+        bool inPlace = pass->writes != 0 && !(pass->writes & MAP_PART_LAYOUT);
+        if(inPlace && (pipeline->map.ownership == MAP_BORROWED || pipeline->map.ownership == MAP_MAPPED)) {
+            MapData copy = mapAllocate(pipeline->map.length);
+            memcpy(copy.buffer, pipeline->map.buffer, pipeline->map.length);
+            pipeline_replaceMap(pipeline, copy);
+        }
+        if((pass->reads & MAP_PART_TAG_INDEX) && !pipeline->hasTagIndex) {
+            pipeline->tagIndex = buildMapTagIndex(pipeline->map);
+            pipeline->hasTagIndex = true;
+        }
+        
+        TraceSpan span = traceBegin(pass->name);
+        bool succeeded = pass->run(pipeline);
+        traceEnd(span);
+        pipeline->ran++;
+        
+        //the shared index outlives a pass unless the pass changed the tag array without keeping the index up to date
+        if(pipeline->hasTagIndex && (pass->writes & (MAP_PART_TAG_CLASSES | MAP_PART_TAG_NAMES | MAP_PART_LAYOUT)) && !(pass->writes & MAP_PART_TAG_INDEX)) {
+            freeMapTagIndex(&pipeline->tagIndex);
+            pipeline->hasTagIndex = false;
+        }
+        if(!succeeded) return pass;
+    }
+    return NULL;
+}
+
+void mapPipelineClose(MapPipeline *pipeline) {
+    if(pipeline->hasTagIndex) freeMapTagIndex(&pipeline->tagIndex);
+    pipeline->hasTagIndex = false;
+    mapClose(&pipeline->map);
+}
@@ -0,0 +1,72 @@
+// ZZTPipeline.h
+
+/*
+ 
+ Copyright (c) 2014, Paul Whitcomb
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * Neither the name of Paul Whitcomb nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ 
+ */
+
+#include "ZZTDeathstar.h"
+#include "ZZTMapIndex.h"
+
+#ifndef deathstar_ZZTPipeline_h
+#define deathstar_ZZTPipeline_h
+
+#define MAX_MAP_PASSES 0x20
+
+typedef enum {
+    MAP_PART_HEADER      = 0x01,
+    MAP_PART_TAG_CLASSES = 0x02, //classA in the tag array
+    MAP_PART_TAG_NAMES   = 0x04, //nameOffset and the strings it points to
+    MAP_PART_TAG_DATA    = 0x08,
+    MAP_PART_LAYOUT      = 0x10, //lengths, offsets and which tags exist; a pass that writes this builds a new buffer
+    MAP_PART_TAG_INDEX   = 0x20, //the pipeline's shared MapTagIndex
+    MAP_PART_ALL         = 0x3F
+} MapPart;
+
+typedef struct {
+    MapData map;                 //owned by the pipeline once it runs; passes may replace it
+    MapTagIndex tagIndex;        //valid while hasTagIndex is set
+    bool hasTagIndex;
+    ZTeamOptions zteam;
+    NameDeprotectOptions names;
+    const char *savePath;        //for the save pass
+    int saveDescriptor;          //used instead of savePath when it isn't -1
+    uint32_t checksum;           //from the last checksum pass
+    uint32_t removedTags;        //by strip passes
+    uint32_t mergedTags;         //by merge passes
+    uint32_t ran;
+    uint32_t skipped;            //passes whose input hadn't changed since they last ran
+} MapPipeline;
+
+typedef bool (*MapPassFunction)(MapPipeline *pipeline); //false stops the pipeline
+
+typedef struct {
+    const char *name;
+    uint32_t reads;              //MapParts the pass looks at; only used to skip passes and to copy borrowed maps, not to fuse them
+    uint32_t writes;             //MapParts it changes; anything but MAP_PART_LAYOUT is changed in place
+    bool repeatable;             //running it again on unchanged input would do nothing new
+    MapPassFunction run;
+} MapPass;
+
+const MapPass *findMapPass(const char *name); //zteam, name, merge, strip, checksum or save; NULL if there's no such pass
+const char *parseMapPasses(const char *list, const MapPass **passes, uint32_t *count); //comma-separated names, up to MAX_MAP_PASSES; why the list can't be run, or NULL
+void mapPipelineInit(MapPipeline *pipeline, MapData map);
+const MapPass *runMapPipeline(MapPipeline *pipeline, const MapPass *const *passes, uint32_t count); //the pass that failed, or NULL
+void mapPipelineClose(MapPipeline *pipeline); //closes the map and the shared index
+
+void zteam_deprotectWithIndex(MapData map, ZTeamOptions options, MapTagIndex *sharedIndex); //in place; keeps the index's classes up to date
+MapData name_deprotectWithIndex(MapData map, NameDeprotectOptions options, const MapTagIndex *sharedIndex); //NULL builds an index
+
+#endif
@@ -0,0 +1,175 @@
+// ZZTScan.c
+
+/*
+ 
+ Copyright (c) 2014, Paul Whitcomb
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * Neither the name of Paul Whitcomb nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ 
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#ifdef _WIN32
+#include <io.h>
+#define open(path, flags) _open(path, (flags) | _O_BINARY)
+#define close _close
+#else
+#include <unistd.h>
+#endif
+#include "ZZTScan.h"
+#include "ZZTTagData.h"
+#include "ZZTEngine.h"
+#include "ZZTTagClasses.h"
+#include "ZZTParallel.h"
+#include "ZZTTrace.h"
+
+#define NO_PARENT_CLASS 0xFFFFFFFF
+
+typedef struct {
+    const char *tagClass;
+    const char *parent;
+    const char *grandparent;
+} ScanClassParents;
+
+static const ScanClassParents scanParents[] = { //classes not listed here have no parents
+    {BIPD, UNIT, OBJE}, {VEHI, UNIT, OBJE},
+    {WEAP, ITEM, OBJE}, {EQIP, ITEM, OBJE}, {GARB, ITEM, OBJE},
+    {MACH, DEVI, OBJE}, {CTRL, DEVI, OBJE}, {LIFI, DEVI, OBJE},
+    {UNIT, OBJE, NULL}, {ITEM, OBJE, NULL}, {DEVI, OBJE, NULL},
+    {PROJ, OBJE, NULL}, {SCEN, OBJE, NULL}, {PLAC, OBJE, NULL}, {SSCE, OBJE, NULL},
+    {SENV, SHDR, NULL}, {SOSO, SHDR, NULL}, {SOTR, SHDR, NULL}, {SCHI, SHDR, NULL}, {SCEX, SHDR, NULL},
+    {SWAT, SHDR, NULL}, {SGLA, SHDR, NULL}, {SMET, SHDR, NULL}, {SPLA, SHDR, NULL}
+};
+
+static bool scan_read(int file, void *buffer, size_t size, uint64_t offset) {
+#ifdef _WIN32
+    if(_lseeki64(file, offset, SEEK_SET) < 0) return false;
+    return _read(file, buffer, (unsigned int)size) == (int)size;
+#else
+    return pread(file, buffer, size, (off_t)offset) == (ssize_t)size;
+#endif
+}
+
+static bool scan_parentsMatch(const MapTag *tag) {
+    uint32_t parent = NO_PARENT_CLASS;
+    uint32_t grandparent = NO_PARENT_CLASS;
+    for(uint32_t i=0;i<sizeof(scanParents)/sizeof(*scanParents);i++) {
+        if(tag->classA == *(uint32_t *)scanParents[i].tagClass) {
+            parent = *(uint32_t *)scanParents[i].parent;
+            if(scanParents[i].grandparent) grandparent = *(uint32_t *)scanParents[i].grandparent;
+            break;
+        }
+    }
+    return tag->classB == parent && tag->classC == grandparent;
+}
+
+static void scan_countClass(MapScan *scan, uint32_t tagClass) {
+    for(uint32_t i=0;i<scan->classCount;i++) {
+        if(scan->classes[i].tagClass == tagClass) {
+            scan->classes[i].count++;
+            return;
+        }
+    }
+    scan->classes[scan->classCount].tagClass = tagClass;
+    scan->classes[scan->classCount].count = 1;
+    scan->classCount++;
+}
+
+static MapTag *scan_readTags(int file, MapScan *scan, HaloMapHeader *header, uint64_t *metaEnd, uint64_t *fileSize) { //NULL with scan->error set if the map isn't usable
+    struct stat info;
+    scan->error = MAP_INVALID_HEADER;
+    if(fstat(file, &info) != 0 || !scan_read(file, header, sizeof(*header), 0)) return NULL;
+    if(memcmp(&header->integrityHead, "daeh", 4) != 0 || memcmp(&header->integrityFoot, "toof", 4) != 0) return NULL;
+    scan->version = header->version;
+    
+    //the index and the tag array have to be inside both the file and the meta region
+    *fileSize = (uint64_t)info.st_size;
+    *metaEnd = (uint64_t)header->indexOffset + header->metaSize;
+    if(*metaEnd > *fileSize) *metaEnd = *fileSize;
+    HaloMapIndex index;
+    scan->error = MAP_INVALID_INDEX_POINTER;
+    if((uint64_t)header->indexOffset + sizeof(index) > *metaEnd || !scan_read(file, &index, sizeof(index), header->indexOffset)) return NULL;
+    uint32_t magic = haloMapMagic(header);
+    uint64_t tagsOffset = (uint32_t)(index.tagIndexOffset - magic);
+    if(tagsOffset < header->indexOffset || tagsOffset > *metaEnd || (*metaEnd - tagsOffset) / sizeof(MapTag) < index.tagCount) return NULL;
+    MapTag *tags = malloc(sizeof(MapTag) * index.tagCount + 1);
+    if(tags == NULL || !scan_read(file, tags, sizeof(MapTag) * index.tagCount, tagsOffset)) {
+        free(tags);
+        return NULL;
+    }
+    scan->tagCount = index.tagCount;
+    scan->error = MAP_OK;
+    return tags;
+}
+
+MapScan scanMapAtPath(const char *path) {
+    MapScan scan;
+    memset(&scan, 0, sizeof(scan));
+    scan.error = MAP_INVALID_PATH;
+    int file = open(path, O_RDONLY);
+    if(file < 0) return scan;
+    TraceSpan span = traceBegin("scan map");
+    HaloMapHeader header;
+    uint64_t metaEnd = 0;
+    uint64_t fileSize = 0;
+    MapTag *tags = scan_readTags(file, &scan, &header, &metaEnd, &fileSize);
+    close(file);
+    if(tags == NULL) {
+        traceEnd(span);
+        return scan;
+    }
+    
+    uint32_t magic = haloMapMagic(&header);
+    scan.classes = malloc(sizeof(ScanClassCount) * scan.tagCount + 1);
+    for(uint32_t i=0;i<scan.tagCount;i++) {
+        scan_countClass(&scan, tags[i].classA);
+        if(!isHaloClass(tags[i].classA)) scan.unknownClasses++;
+        else if(!scan_parentsMatch(&tags[i])) scan.mismatchedClasses++;
+        uint64_t name = (uint32_t)(tags[i].nameOffset - magic);
+        if(name >= fileSize) scan.invalidNameOffsets++;
+        else if(name < header.indexOffset || name >= metaEnd) scan.namesOutsideMeta++;
+    }
+    scan.protected = scan.unknownClasses || scan.mismatchedClasses || scan.invalidNameOffsets || scan.namesOutsideMeta;
+    free(tags);
+    traceEnd(span);
+    return scan;
+}
+
+typedef struct {
+    const char *const *paths;
+    MapScan *results;
+} ScanJob;
+
+static void scan_slice(void *context, uint32_t start, uint32_t end) {
+    ScanJob *job = context;
+    for(uint32_t i=start;i<end;i++) {
+        traceSetMap(job->paths[i]);
+        job->results[i] = scanMapAtPath(job->paths[i]);
+    }
+}
+
+void scanMaps(const char *const *paths, uint32_t count, MapScan *results, uint32_t threads) {
+    ScanJob job;
+    job.paths = paths;
+    job.results = results;
+    parallelFor(count, threads, scan_slice, &job);
+}
+
+void freeMapScan(MapScan *scan) {
+    free(scan->classes);
+    scan->classes = NULL;
+    scan->classCount = 0;
+}
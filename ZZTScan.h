@@ -0,0 +1,48 @@
+// ZZTScan.h
+
+/*
+ 
+ Copyright (c) 2014, Paul Whitcomb
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * Neither the name of Paul Whitcomb nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ 
+ */
+
+#include "ZZTDeathstar.h"
+#include "ZZTEngine.h"
+
+#ifndef deathstar_ZZTScan_h
+#define deathstar_ZZTScan_h
+
+typedef struct {
+    uint32_t tagClass;
+    uint32_t count;
+} ScanClassCount;
+
+typedef struct {
+    MapError error;
+    uint32_t version;
+    uint32_t tagCount;
+    ScanClassCount *classes;     //one entry per distinct classA, in order of first appearance
+    uint32_t classCount;
+    uint32_t unknownClasses;     //tags whose classA isn't a Halo class
+    uint32_t mismatchedClasses;  //tags whose classA disagrees with the parent classes stored beside it
+    uint32_t invalidNameOffsets; //tags whose name is outside the file
+    uint32_t namesOutsideMeta;   //tags whose name is in the file, but not in the meta region
+    bool protected;
+} MapScan;
+
+MapScan scanMapAtPath(const char *path); //only reads the header, the index and the tag array
+void scanMaps(const char *const *paths, uint32_t count, MapScan *results, uint32_t threads); //results[i] is the scan of paths[i]
+void freeMapScan(MapScan *scan);
+
+#endif
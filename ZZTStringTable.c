@@ -0,0 +1,103 @@
+// ZZTStringTable.c
+
+/*
+ 
+ Copyright (c) 2014, Paul Whitcomb
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * Neither the name of Paul Whitcomb nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ 
+ */
+
+#include "ZZTStringTable.h"
+#include "ZZTArena.h"
+
+typedef struct {
+    const char *string;
+    uint32_t length;
+    uint32_t index;
+} StringTableEntry;
+
+static int compareReversedStrings(const void *a, const void *b) { //orders strings by their reversed text, so a suffix sorts right before the strings ending with it
+    const StringTableEntry *entryA = a;
+    const StringTableEntry *entryB = b;
+    uint32_t length = entryA->length < entryB->length ? entryA->length : entryB->length;
+    for(uint32_t i=1;i<=length;i++) {
+        unsigned char charA = entryA->string[entryA->length - i];
+        unsigned char charB = entryB->string[entryB->length - i];
+        if(charA != charB) return charA < charB ? -1 : 1;
+    }
+    if(entryA->length != entryB->length) return entryA->length < entryB->length ? -1 : 1;
+    return entryA->index < entryB->index ? -1 : entryA->index > entryB->index;
+}
+
+static bool isSuffixOf(const StringTableEntry *suffix, const StringTableEntry *string) {
+    if(suffix->length > string->length) return false;
+    return memcmp(string->string + string->length - suffix->length, suffix->string, suffix->length) == 0;
+}
+
+StringTable buildStringTable(const char **strings, uint32_t count) {
+    StringTable table;
+    table.count = count;
+    table.length = 0;
+    table.offsets = deathstarAlloc(sizeof(uint32_t) * (count ? count : 1));
+    
+    StringTableEntry *entries = deathstarAlloc(sizeof(StringTableEntry) * (count ? count : 1));
+    uint32_t *hosts = deathstarAlloc(sizeof(uint32_t) * (count ? count : 1)); //the string each one is stored inside of
+    for(uint32_t i=0;i<count;i++) {
+        entries[i].string = strings[i];
+        entries[i].length = (uint32_t)strlen(strings[i]);
+        entries[i].index = i;
+        hosts[i] = i;
+    }
+    qsort(entries, count, sizeof(StringTableEntry), compareReversedStrings);
+    
+    //walking backwards, every string ending with the current one was just visited, and the longest of those comes first
+    for(uint32_t i=count;i-- > 1;) {
+        if(isSuffixOf(&entries[i - 1], &entries[i])) {
+            hosts[entries[i - 1].index] = hosts[entries[i].index];
+        }
+    }
+    
+    //strings keep their input order, so a table without any sharing is just the strings back to back
+    uint32_t *lengths = deathstarAlloc(sizeof(uint32_t) * (count ? count : 1));
+    for(uint32_t i=0;i<count;i++) {
+        lengths[entries[i].index] = entries[i].length;
+    }
+    for(uint32_t i=0;i<count;i++) {
+        if(hosts[i] == i) table.length += lengths[i] + 1;
+    }
+    table.buffer = deathstarAlloc(table.length ? table.length : 1);
+    uint32_t position = 0;
+    for(uint32_t i=0;i<count;i++) {
+        if(hosts[i] != i) continue;
+        memcpy(table.buffer + position, strings[i], lengths[i] + 1);
+        table.offsets[i] = position;
+        position += lengths[i] + 1;
+    }
+    for(uint32_t i=0;i<count;i++) {
+        if(hosts[i] != i) table.offsets[i] = table.offsets[hosts[i]] + lengths[hosts[i]] - lengths[i];
+    }
+    
+    deathstarFree(lengths);
+    deathstarFree(hosts);
+    deathstarFree(entries);
+    return table;
+}
+
+void freeStringTable(StringTable *table) {
+    deathstarFree(table->buffer);
+    deathstarFree(table->offsets);
+    table->buffer = NULL;
+    table->offsets = NULL;
+    table->count = 0;
+    table->length = 0;
+}
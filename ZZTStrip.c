@@ -0,0 +1,478 @@
+// ZZTStrip.c
+
+/*
+ 
+ Copyright (c) 2014, Paul Whitcomb
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * Neither the name of Paul Whitcomb nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ 
+ */
+
+#include "ZZTStrip.h"
+#include "ZZTTagData.h"
+#include "ZZTEngine.h"
+#include "ZZTTagClasses.h"
+#include "ZZTMapIndex.h"
+#include "ZZTStringTable.h"
+#include "ZZTArena.h"
+#include "ZZTHash.h"
+#include "ZZTParallel.h"
+
+#define STRIP_MAX_REFLEXIVE_COUNT 0x100000
+#define STRIP_NULL_TAG 0xFFFFFFFF
+
+typedef struct {
+    uint32_t oldOffset;
+    uint32_t newOffset;
+    uint32_t size;
+} StripSegment;
+
+typedef struct {
+    MapData map;
+    uint32_t magic;
+    MapTag *tags;
+    uint32_t tagCount;
+    MapRegion *regions;
+    bool *alive;
+    uint32_t *newIdentity;
+    uint32_t *newNameOffset;
+    StripSegment *segments;
+    uint32_t segmentCount;
+    uint32_t metaStart;
+    uint32_t metaEnd;
+} StripState;
+
+static uint32_t strip_tagID(TagID identity) { //compared as the word it's stored as
+    uint32_t word;
+    memcpy(&word, &identity, sizeof(word));
+    return word;
+}
+
+static uint32_t strip_findTag(const StripState *state, uint32_t word) { //tagCount if the word isn't a tag identity
+    uint32_t tag = word & 0xFFFF;
+    if(word == STRIP_NULL_TAG || tag >= state->tagCount || strip_tagID(state->tags[tag].identity) != word) return state->tagCount;
+    return tag;
+}
+
+static bool strip_isMetaPointer(const StripState *state, uint32_t word) {
+    return word >= state->metaStart + state->magic && word < state->metaEnd + state->magic;
+}
+
+static bool strip_isPointerField(const StripState *state, const uint32_t *words, uint32_t offset, uint32_t start, uint32_t end) {
+    if(!strip_isMetaPointer(state, words[0])) return false;
+    //floats near 3.07 look like pointers too, so only take the ones that sit where reflexives and data blocks keep theirs
+    bool reflexive = offset >= start + 4 && offset + 8 <= end && words[-1] > 0 && words[-1] <= STRIP_MAX_REFLEXIVE_COUNT && words[1] == 0;
+    bool dataBlock = offset >= start + 12 && words[-3] > 0 && words[-3] <= state->metaEnd - (words[0] - state->magic);
+    return reflexive || dataBlock;
+}
+
+static uint32_t strip_findOwner(const StripState *state, const uint32_t *owners, uint32_t ownerCount, uint32_t offset) { //the tag whose data holds offset, or tagCount
+    uint32_t low = 0, high = ownerCount;
+    while(low < high) {
+        uint32_t middle = (low + high) / 2;
+        if(state->regions[owners[middle]].offset <= offset) low = middle + 1;
+        else high = middle;
+    }
+    if(low == 0) return state->tagCount;
+    MapRegion region = state->regions[owners[low - 1]];
+    return offset - region.offset < region.size ? owners[low - 1] : state->tagCount;
+}
+
+static THREAD_LOCAL const MapRegion *strip_sortRegions;
+
+static int strip_compareRegions(const void *a, const void *b) {
+    uint32_t offsetA = strip_sortRegions[*(const uint32_t *)a].offset;
+    uint32_t offsetB = strip_sortRegions[*(const uint32_t *)b].offset;
+    return offsetA < offsetB ? -1 : offsetA > offsetB;
+}
+
+static void strip_markReachable(StripState *state, uint32_t *stack, uint32_t stackSize) { //tags named or pointed into by a live tag are live too
+    uint32_t *owners = deathstarAlloc(sizeof(uint32_t) * (state->tagCount + 1));
+    uint32_t ownerCount = 0;
+    for(uint32_t i=0;i<state->tagCount;i++) {
+        if(state->regions[i].size > 0 && state->regions[i].offset >= state->metaStart) owners[ownerCount++] = i;
+    }
+    strip_sortRegions = state->regions;
+    qsort(owners, ownerCount, sizeof(uint32_t), strip_compareRegions);
+    
+    while(stackSize > 0) {
+        MapRegion region = state->regions[stack[--stackSize]];
+        uint32_t start = (region.offset + 3) & ~3;
+        for(uint32_t offset=start;offset + 4 <= region.offset + region.size;offset += 4) {
+            const uint32_t *words = (const uint32_t *)(state->map.buffer + offset);
+            uint32_t tag = strip_findTag(state, words[0]);
+            if(tag == state->tagCount && strip_isPointerField(state, words, offset, start, region.offset + region.size)) {
+                tag = strip_findOwner(state, owners, ownerCount, words[0] - state->magic);
+            }
+            if(tag == state->tagCount || state->alive[tag]) continue;
+            state->alive[tag] = true;
+            stack[stackSize++] = tag;
+        }
+    }
+    deathstarFree(owners);
+}
+
+static int strip_compareSegments(const void *a, const void *b) {
+    const StripSegment *segmentA = a;
+    const StripSegment *segmentB = b;
+    return segmentA->oldOffset < segmentB->oldOffset ? -1 : segmentA->oldOffset > segmentB->oldOffset;
+}
+
+static uint32_t strip_relocate(const StripState *state, uint32_t offset) { //new file offset, or UINT32_MAX if the data is going away
+    uint32_t low = 0, high = state->segmentCount;
+    while(low < high) {
+        uint32_t middle = (low + high) / 2;
+        if(state->segments[middle].oldOffset <= offset) low = middle + 1;
+        else high = middle;
+    }
+    if(low == 0) return UINT32_MAX;
+    const StripSegment *segment = &state->segments[low - 1];
+    if(offset - segment->oldOffset >= segment->size) return UINT32_MAX;
+    return segment->newOffset + (offset - segment->oldOffset);
+}
+
+static bool strip_fixReferences(const StripState *state, char *buffer, uint32_t start, uint32_t end, bool relocatePointers) {
+    start = (start + 3) & ~3;
+    for(uint32_t offset=start;offset + 4 <= end;offset += 4) {
+        uint32_t *words = (uint32_t *)(buffer + offset);
+        if(offset + sizeof(Dependency) <= end && words[2] == 0 && isHaloClass(words[0]) && (words[1] == 0 || strip_isMetaPointer(state, words[1]))) {
+            uint32_t tag = strip_findTag(state, words[3]);
+            if(tag != state->tagCount) {
+                words[1] = state->newNameOffset[tag] + state->magic;
+                words[3] = state->newIdentity[tag];
+                offset += sizeof(Dependency) - 4;
+                continue;
+            }
+            if(words[3] == STRIP_NULL_TAG) {
+                offset += sizeof(Dependency) - 4;
+                continue;
+            }
+        }
+        uint32_t tag = strip_findTag(state, words[0]);
+        if(tag != state->tagCount) {
+            words[0] = state->newIdentity[tag];
+            continue;
+        }
+        if(!relocatePointers || !strip_isPointerField(state, words, offset, start, end)) continue;
+        uint32_t relocated = strip_relocate(state, words[0] - state->magic);
+        if(relocated == UINT32_MAX) return false;
+        words[0] = relocated + state->magic;
+    }
+    return true;
+}
+
+MapData stripDeadTags(MapData map, StripReport *report) {
+    HaloMapHeader *header = (HaloMapHeader *)(map.buffer);
+    HaloMapIndex *index = (HaloMapIndex *)(map.buffer + header->indexOffset);
+    
+    MapData copy = mapAllocate(map.length);
+    memcpy(copy.buffer, map.buffer, map.length);
+    report->removedTags = 0;
+    report->removedBytes = 0;
+    
+    StripState state;
+    state.map = map;
+    state.magic = haloMapMagic(header);
+    state.tags = (MapTag *)(map.buffer + (index->tagIndexOffset - state.magic));
+    state.tagCount = index->tagCount;
+    state.metaStart = header->indexOffset;
+    state.metaEnd = header->indexOffset + header->metaSize;
+    if(state.metaEnd != map.length || state.metaEnd < state.metaStart) { //only the tag data can shrink without moving anything else
+        report->result = STRIP_UNSUPPORTED_LAYOUT;
+        return copy;
+    }
+    
+    MapTagIndex tagIndex = buildMapTagIndex(map);
+    state.regions = deathstarAlloc(sizeof(MapRegion) * (state.tagCount + 1));
+    findTagDataRegions(map, &tagIndex, state.regions);
+    state.alive = deathstarCalloc(state.tagCount + 1);
+    
+    //the engine loads the scenario, the globals, and the shared ui\ and sound\ tags on its own
+    uint32_t *stack = deathstarAlloc(sizeof(uint32_t) * (state.tagCount + 1));
+    uint32_t stackSize = 0;
+    for(uint32_t i=0;i<state.tagCount;i++) {
+        bool root = i == index->scenarioTag.tagTableIndex;
+        root = root || tagIndex.classA[i] == *(uint32_t *)&MATG || tagIndex.classA[i] == *(uint32_t *)&TAGC || tagIndex.classA[i] == *(uint32_t *)&SOUL;
+        root = root || (tagIndex.flags[i] & (TAG_INDEX_GLOBALS | TAG_INDEX_SHARED_NAME));
+        if(!root) continue;
+        state.alive[i] = true;
+        stack[stackSize++] = i;
+    }
+    strip_markReachable(&state, stack, stackSize);
+    deathstarFree(stack);
+    
+    uint32_t aliveCount = 0;
+    for(uint32_t i=0;i<state.tagCount;i++) {
+        aliveCount += state.alive[i];
+    }
+    report->result = aliveCount == state.tagCount ? STRIP_NOTHING_TO_REMOVE : STRIP_OK;
+    
+    //live tag data, in file order, packed after the shortened tag array
+    state.segments = deathstarAlloc(sizeof(StripSegment) * (state.tagCount + 1));
+    state.segmentCount = 0;
+    for(uint32_t i=0;i<state.tagCount && report->result == STRIP_OK;i++) {
+        MapRegion region = state.regions[i];
+        if(!state.alive[i] || region.size == 0 || region.offset < state.metaStart || region.offset >= state.metaEnd) continue;
+        state.segments[state.segmentCount].oldOffset = region.offset;
+        state.segments[state.segmentCount++].size = region.size;
+    }
+    qsort(state.segments, state.segmentCount, sizeof(StripSegment), strip_compareSegments);
+    uint32_t merged = 0;
+    for(uint32_t i=0;i<state.segmentCount;i++) {
+        if(merged > 0 && state.segments[i].oldOffset <= state.segments[merged - 1].oldOffset + state.segments[merged - 1].size) {
+            uint32_t end = state.segments[i].oldOffset + state.segments[i].size;
+            if(end > state.segments[merged - 1].oldOffset + state.segments[merged - 1].size) state.segments[merged - 1].size = end - state.segments[merged - 1].oldOffset;
+        }
+        else {
+            state.segments[merged++] = state.segments[i];
+        }
+    }
+    state.segmentCount = merged;
+    uint32_t cursor = state.metaStart + sizeof(HaloMapIndex) + aliveCount * sizeof(MapTag);
+    for(uint32_t i=0;i<state.segmentCount;i++) {
+        cursor = ((cursor + 3) & ~3) + (state.segments[i].oldOffset & 3);
+        state.segments[i].newOffset = cursor;
+        cursor += state.segments[i].size;
+    }
+    
+    //renumber the live tags, keeping each salt's distance from its index
+    state.newIdentity = deathstarAlloc(sizeof(uint32_t) * (state.tagCount + 1));
+    state.newNameOffset = deathstarAlloc(sizeof(uint32_t) * (state.tagCount + 1));
+    const char **names = deathstarAlloc(sizeof(char *) * (aliveCount + 1));
+    uint32_t nextTag = 0;
+    for(uint32_t i=0;i<state.tagCount;i++) {
+        if(!state.alive[i]) continue;
+        TagID identity = state.tags[i].identity;
+        identity.tableIndex = (uint16_t)(identity.tableIndex - identity.tagTableIndex + nextTag);
+        identity.tagTableIndex = (uint16_t)nextTag;
+        state.newIdentity[i] = strip_tagID(identity);
+        uint32_t nameOffset = state.tags[i].nameOffset - state.magic;
+        names[nextTag++] = (tagIndex.flags[i] & TAG_INDEX_NAME_IN_MAP) && memchr(map.buffer + nameOffset, 0, map.length - nameOffset) ? map.buffer + nameOffset : "";
+    }
+    StringTable nameTable = buildStringTable(names, aliveCount);
+    nextTag = 0;
+    for(uint32_t i=0;i<state.tagCount;i++) {
+        if(state.alive[i]) state.newNameOffset[i] = cursor + nameTable.offsets[nextTag++];
+    }
+    uint32_t newLength = cursor + nameTable.length;
+    
+    char *buffer = report->result == STRIP_OK ? deathstarCalloc(newLength) : NULL;
+    if(buffer) {
+        memcpy(buffer, map.buffer, state.metaStart);
+        memcpy(buffer + state.metaStart, index, sizeof(HaloMapIndex));
+        for(uint32_t i=0;i<state.segmentCount;i++) {
+            memcpy(buffer + state.segments[i].newOffset, map.buffer + state.segments[i].oldOffset, state.segments[i].size);
+        }
+        memcpy(buffer + cursor, nameTable.buffer, nameTable.length);
+        
+        HaloMapIndex *newIndex = (HaloMapIndex *)(buffer + state.metaStart);
+        MapTag *newTags = (MapTag *)(newIndex + 1);
+        newIndex->tagIndexOffset = state.metaStart + sizeof(HaloMapIndex) + state.magic;
+        newIndex->tagCount = aliveCount;
+        uint32_t scenario = strip_findTag(&state, strip_tagID(index->scenarioTag));
+        if(scenario != state.tagCount) memcpy(&newIndex->scenarioTag, &state.newIdentity[scenario], sizeof(TagID));
+        
+        nextTag = 0;
+        for(uint32_t i=0;i<state.tagCount && report->result == STRIP_OK;i++) {
+            if(!state.alive[i]) continue;
+            MapTag *tag = &newTags[nextTag++];
+            *tag = state.tags[i];
+            memcpy(&tag->identity, &state.newIdentity[i], sizeof(TagID));
+            tag->nameOffset = state.newNameOffset[i] + state.magic;
+            uint32_t dataOffset = tag->dataOffset - state.magic;
+            if((tagIndex.flags[i] & TAG_INDEX_EXTERNAL) || dataOffset < state.metaStart || dataOffset >= state.metaEnd) continue;
+            uint32_t relocated = strip_relocate(&state, dataOffset);
+            if(relocated == UINT32_MAX) report->result = STRIP_DANGLING_POINTER;
+            else tag->dataOffset = relocated + state.magic;
+        }
+        for(uint32_t i=0;i<state.segmentCount && report->result == STRIP_OK;i++) {
+            if(!strip_fixReferences(&state, buffer, state.segments[i].newOffset, state.segments[i].newOffset + state.segments[i].size, true)) report->result = STRIP_DANGLING_POINTER;
+        }
+        for(uint32_t i=0;i<state.tagCount && report->result == STRIP_OK;i++) { //BSPs keep their place, but not the tags they point at
+            MapRegion region = state.regions[i];
+            if(state.alive[i] && region.size > 0 && region.offset + region.size <= state.metaStart) {
+                strip_fixReferences(&state, buffer, region.offset, region.offset + region.size, false);
+            }
+        }
+        
+        HaloMapHeader *newHeader = (HaloMapHeader *)buffer;
+        newHeader->length = newLength;
+        newHeader->metaSize = newLength - state.metaStart;
+    }
+    
+    freeStringTable(&nameTable);
+    deathstarFree(names);
+    deathstarFree(state.newNameOffset);
+    deathstarFree(state.newIdentity);
+    deathstarFree(state.segments);
+    deathstarFree(state.alive);
+    deathstarFree(state.regions);
+    freeMapTagIndex(&tagIndex);
+    
+    if(report->result != STRIP_OK) {
+        deathstarFree(buffer);
+        return copy;
+    }
+    deathstarFree(copy.buffer);
+    report->removedTags = state.tagCount - aliveCount;
+    report->removedBytes = map.length > newLength ? map.length - newLength : 0;
+    copy.buffer = buffer;
+    copy.length = newLength;
+    return copy;
+}
+
+#define MERGE_MAX_ROUNDS 0x10
+
+typedef struct {
+    uint32_t tag;
+    uint32_t wordCount;
+    uint64_t hash;
+    uint32_t *words;        //the tag's data with its names and internal pointers factored out
+} MergeCandidate;
+
+static bool merge_isDependency(const StripState *state, const uint32_t *words, uint32_t offset, uint32_t end) {
+    return offset + sizeof(Dependency) <= end && words[2] == 0 && isHaloClass(words[0]) && (words[1] == 0 || strip_isMetaPointer(state, words[1]));
+}
+
+static uint32_t merge_normalize(const StripState *state, uint32_t tag, uint32_t *normalized) { //returns the word count
+    MapRegion region = state->regions[tag];
+    uint32_t end = region.offset + region.size;
+    uint32_t count = 0;
+    for(uint32_t offset=region.offset;offset + 4 <= end;offset += 4) {
+        const uint32_t *words = (const uint32_t *)(state->map.buffer + offset);
+        if(merge_isDependency(state, words, offset, end)) { //names don't matter, only what they point at
+            normalized[count++] = words[0];
+            normalized[count++] = 0;
+            normalized[count++] = words[2];
+            normalized[count++] = words[3];
+            offset += sizeof(Dependency) - 4;
+        }
+        else if(strip_isPointerField(state, words, offset, region.offset, end) && words[0] - state->magic - region.offset < region.size) {
+            normalized[count++] = words[0] - state->magic - region.offset;
+        }
+        else {
+            normalized[count++] = words[0];
+        }
+    }
+    return count;
+}
+
+static int merge_compareCandidates(const void *a, const void *b) {
+    const MergeCandidate *candidateA = a;
+    const MergeCandidate *candidateB = b;
+    if(candidateA->hash != candidateB->hash) return candidateA->hash < candidateB->hash ? -1 : 1;
+    if(candidateA->wordCount != candidateB->wordCount) return candidateA->wordCount < candidateB->wordCount ? -1 : 1;
+    return candidateA->tag < candidateB->tag ? -1 : candidateA->tag > candidateB->tag;
+}
+
+static void merge_redirectReferences(const StripState *state, const uint32_t *canonical, uint32_t start, uint32_t end) {
+    start = (start + 3) & ~3;
+    for(uint32_t offset=start;offset + 4 <= end;offset += 4) {
+        uint32_t *words = (uint32_t *)(state->map.buffer + offset);
+        uint32_t *identity = words;
+        if(merge_isDependency(state, words, offset, end)) {
+            identity = &words[3];
+            offset += sizeof(Dependency) - 4;
+        }
+        uint32_t tag = strip_findTag(state, *identity);
+        if(tag == state->tagCount || canonical[tag] == tag) continue;
+        *identity = strip_tagID(state->tags[canonical[tag]].identity);
+        if(identity != words) words[1] = state->tags[canonical[tag]].nameOffset;
+    }
+}
+
+MapData mergeDuplicateTags(MapData map, MergeReport *report) {
+    MapData copy = mapAllocate(map.length);
+    memcpy(copy.buffer, map.buffer, map.length);
+    report->mergedTags = 0;
+    report->rounds = 0;
+    
+    HaloMapHeader *header = (HaloMapHeader *)(copy.buffer);
+    HaloMapIndex *index = (HaloMapIndex *)(copy.buffer + header->indexOffset);
+    StripState state;
+    state.map = copy;
+    state.magic = haloMapMagic(header);
+    state.tags = (MapTag *)(copy.buffer + (index->tagIndexOffset - state.magic));
+    state.tagCount = index->tagCount;
+    state.metaStart = header->indexOffset;
+    state.metaEnd = header->indexOffset + header->metaSize;
+    if(state.metaEnd > copy.length || state.metaEnd < state.metaStart) state.metaEnd = copy.length;
+    
+    MapTagIndex tagIndex = buildMapTagIndex(copy);
+    state.regions = deathstarAlloc(sizeof(MapRegion) * (state.tagCount + 1));
+    findTagDataRegions(copy, &tagIndex, state.regions);
+    uint32_t *canonical = deathstarAlloc(sizeof(uint32_t) * (state.tagCount + 1));
+    bool *merged = deathstarCalloc(state.tagCount + 1);
+    MergeCandidate *candidates = deathstarAlloc(sizeof(MergeCandidate) * (state.tagCount + 1));
+    size_t dataSize = 0;
+    for(uint32_t i=0;i<state.tagCount;i++) {
+        dataSize += state.regions[i].size;
+    }
+    uint32_t *normalized = deathstarAlloc(dataSize + sizeof(uint32_t));
+    
+    //merging clones can make the tags that used them identical too, so go until nothing changes
+    uint32_t mergedThisRound = 1;
+    while(mergedThisRound > 0 && report->rounds < MERGE_MAX_ROUNDS) {
+        mergedThisRound = 0;
+        report->rounds++;
+        uint32_t candidateCount = 0;
+        uint32_t used = 0;
+        for(uint32_t i=0;i<state.tagCount;i++) {
+            canonical[i] = i;
+            MapRegion region = state.regions[i];
+            bool root = i == index->scenarioTag.tagTableIndex || (tagIndex.flags[i] & (TAG_INDEX_EXTERNAL | TAG_INDEX_GLOBALS));
+            if(root || merged[i] || region.size < 4 || (region.offset & 3) || region.offset < state.metaStart || region.offset + region.size > state.metaEnd) continue;
+            MergeCandidate *candidate = &candidates[candidateCount++];
+            candidate->tag = i;
+            candidate->words = normalized + used;
+            candidate->wordCount = merge_normalize(&state, i, candidate->words);
+            candidate->hash = hash64(candidate->words, candidate->wordCount * 4, tagIndex.classA[i]);
+            used += candidate->wordCount;
+        }
+        qsort(candidates, candidateCount, sizeof(MergeCandidate), merge_compareCandidates);
+        
+        for(uint32_t run=0;run<candidateCount;) {
+            uint32_t runEnd = run + 1;
+            while(runEnd < candidateCount && candidates[runEnd].hash == candidates[run].hash && candidates[runEnd].wordCount == candidates[run].wordCount) runEnd++;
+            for(uint32_t j=run + 1;j<runEnd;j++) { //the lowest tag index with the same contents wins
+                MergeCandidate *clone = &candidates[j];
+                for(uint32_t k=run;k<j;k++) {
+                    MergeCandidate *original = &candidates[k];
+                    if(canonical[original->tag] != original->tag || tagIndex.classA[original->tag] != tagIndex.classA[clone->tag]) continue;
+                    if(memcmp(original->words, clone->words, clone->wordCount * 4) != 0) continue;
+                    canonical[clone->tag] = original->tag;
+                    merged[clone->tag] = true;
+                    mergedThisRound++;
+                    break;
+                }
+            }
+            run = runEnd;
+        }
+        
+        if(mergedThisRound == 0) break;
+        for(uint32_t i=0;i<state.tagCount;i++) {
+            MapRegion region = state.regions[i];
+            if(region.size > 0 && region.offset + region.size <= copy.length && !(tagIndex.flags[i] & TAG_INDEX_EXTERNAL)) {
+                merge_redirectReferences(&state, canonical, region.offset, region.offset + region.size);
+            }
+        }
+        report->mergedTags += mergedThisRound;
+    }
+    
+    deathstarFree(normalized);
+    deathstarFree(candidates);
+    deathstarFree(merged);
+    deathstarFree(canonical);
+    deathstarFree(state.regions);
+    freeMapTagIndex(&tagIndex);
+    return copy;
+}
@@ -0,0 +1,47 @@
+// ZZTStrip.h
+
+/*
+ 
+ Copyright (c) 2014, Paul Whitcomb
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * Neither the name of Paul Whitcomb nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ 
+ */
+
+#include "ZZTDeathstar.h"
+
+#ifndef deathstar_ZZTStrip_h
+#define deathstar_ZZTStrip_h
+
+typedef enum {
+    STRIP_OK,
+    STRIP_NOTHING_TO_REMOVE,
+    STRIP_UNSUPPORTED_LAYOUT,        //something is stored after the tag data
+    STRIP_DANGLING_POINTER           //a kept tag points into data that would be removed
+} StripResult;
+
+typedef struct {
+    StripResult result;
+    uint32_t removedTags;
+    uint32_t removedBytes;
+} StripReport;
+
+MapData stripDeadTags(MapData map, StripReport *report); //always returns a new buffer; it's an unchanged copy unless the result is STRIP_OK
+
+typedef struct {
+    uint32_t mergedTags;
+    uint32_t rounds;
+} MergeReport;
+
+MapData mergeDuplicateTags(MapData map, MergeReport *report); //clones stay in the map, unreferenced, until stripDeadTags removes them
+
+#endif
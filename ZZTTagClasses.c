@@ -18,91 +18,125 @@
  */
 
 #include <stdio.h>
+#include <string.h>
 #include "ZZTTagClasses.h"
 
-const char *translateHaloClassToName(uint32_t className) { //from Halo Editing Kit
-    if(className == *(uint32_t *)&ACTR) return "actor";
-    else if(className == *(uint32_t *)&ACTV) return "actor variant";
-    else if(className == *(uint32_t *)&ANT) return "antenna";
-    else if(className == *(uint32_t *)&ANTR) return "model animations";
-    else if(className == *(uint32_t *)&BIPD) return "biped";
-    else if(className == *(uint32_t *)&BITM) return "bitmap";
-    else if(className == *(uint32_t *)&BOOM) return "spheroid";
-    else if(className == *(uint32_t *)&CDMG) return "continuous damage effect";
-    else if(className == *(uint32_t *)&COLL) return "model collision geometry";
-    else if(className == *(uint32_t *)&COLO) return "color table";
-    else if(className == *(uint32_t *)&CONT) return "contrail";
-    else if(className == *(uint32_t *)&CTRL) return "device control";
-    else if(className == *(uint32_t *)&DECA) return "decal";
-    else if(className == *(uint32_t *)&DELA) return "ui widget definition";
-    else if(className == *(uint32_t *)&DEVC) return "input device defaults";
-    else if(className == *(uint32_t *)&DEVI) return "device";
-    else if(className == *(uint32_t *)&DOBC) return "detail object collection";
-    else if(className == *(uint32_t *)&EFFE) return "effect";
-    else if(className == *(uint32_t *)&ELEC) return "electricity";
-    else if(className == *(uint32_t *)&EQIP) return "equipment";
-    else if(className == *(uint32_t *)&FLAG) return "flag";
-    else if(className == *(uint32_t *)&FOG ) return "fog";
-    else if(className == *(uint32_t *)&FONT) return "font";
-    else if(className == *(uint32_t *)&FOOT) return "material effects";
-    else if(className == *(uint32_t *)&GARB) return "garbage";
-    else if(className == *(uint32_t *)&GLW) return "glow";
-    else if(className == *(uint32_t *)&GRHI) return "grenade hud interface";
-    else if(className == *(uint32_t *)&HMT ) return "hud message text";
-    else if(className == *(uint32_t *)&HUD) return "hud number";
-    else if(className == *(uint32_t *)&HUDG) return "hud globals";
-    else if(className == *(uint32_t *)&ITEM) return "item";
-    else if(className == *(uint32_t *)&ITMC) return "item collection";
-    else if(className == *(uint32_t *)&JPT) return "damage effect";
-    else if(className == *(uint32_t *)&LENS) return "lens flare";
-    else if(className == *(uint32_t *)&LIFI) return "device light fixture";
-    else if(className == *(uint32_t *)&LIGH) return "light";
-    else if(className == *(uint32_t *)&LSND) return "sound looping";
-    else if(className == *(uint32_t *)&MACH) return "device machinery";
-    else if(className == *(uint32_t *)&MATG) return "game globals";
-    else if(className == *(uint32_t *)&METR) return "meter";
-    else if(className == *(uint32_t *)&MGS2) return "light volume";
-    else if(className == *(uint32_t *)&MOD2) return "gearbox model";
-    else if(className == *(uint32_t *)&MODE) return "model";
-    else if(className == *(uint32_t *)&MPLY) return "multiplayer scenario description";
-    else if(className == *(uint32_t *)&NGPR) return "network game preferences";
-    else if(className == *(uint32_t *)&OBJE) return "object";
-    else if(className == *(uint32_t *)&PART) return "particle";
-    else if(className == *(uint32_t *)&PCTL) return "particle system";
-    else if(className == *(uint32_t *)&PHYS) return "physics";
-    else if(className == *(uint32_t *)&PLAC) return "placeholder";
-    else if(className == *(uint32_t *)&PPHY) return "point physics";
-    else if(className == *(uint32_t *)&PROJ) return "projectile";
-    else if(className == *(uint32_t *)&RAIN) return "weather";
-    else if(className == *(uint32_t *)&SBSP) return "scenario structure binary space partition";
-    else if(className == *(uint32_t *)&SCEN) return "scenery";
-    else if(className == *(uint32_t *)&SCEX) return "shader transparent chicago extended";
-    else if(className == *(uint32_t *)&SCHI) return "shader transparent chicago";
-    else if(className == *(uint32_t *)&SCNR) return "scenario";
-    else if(className == *(uint32_t *)&SENV) return "shader environment";
-    else if(className == *(uint32_t *)&SGLA) return "shader transparent glass";
-    else if(className == *(uint32_t *)&SHDR) return "shader";
-    else if(className == *(uint32_t *)&SKY ) return "sky";
-    else if(className == *(uint32_t *)&SMET) return "shader transparent meter";
-    else if(className == *(uint32_t *)&SND) return "sound";
-    else if(className == *(uint32_t *)&SNDE) return "sound environment";
-    else if(className == *(uint32_t *)&SOSO) return "shader model";
-    else if(className == *(uint32_t *)&SOTR) return "shader transparent generic";
-    else if(className == *(uint32_t *)&SOUL) return "ui widget collection";
-    else if(className == *(uint32_t *)&SPLA) return "shader transparent plasma";
-    else if(className == *(uint32_t *)&SSCE) return "sound scenery";
-    else if(className == *(uint32_t *)&STR) return "string list";
-    else if(className == *(uint32_t *)&SWAT) return "shader transparent water";
-    else if(className == *(uint32_t *)&TAGC) return "tag collection";
-    else if(className == *(uint32_t *)&TRAK) return "camera track";
-    else if(className == *(uint32_t *)&UDLG) return "unit dialogue";
-    else if(className == *(uint32_t *)&UNHI) return "unit hud interface";
-    else if(className == *(uint32_t *)&UNIT) return "unit";
-    else if(className == *(uint32_t *)&USTR) return "unicode string list";
-    else if(className == *(uint32_t *)&VCKY) return "virtual keyboard";
-    else if(className == *(uint32_t *)&VEHI) return "vehicle";
-    else if(className == *(uint32_t *)&WEAP) return "weapon";
-    else if(className == *(uint32_t *)&WIND) return "wind";
-    else if(className == *(uint32_t *)&WPHI) return "weapon hud interface";
-    else return "unknown";
-}
\ No newline at end of file
+typedef struct {
+    const char *tagClass;
+    const char *name;
+    const char *extension; //what the tag file is called in the Halo Editing Kit's tags folder
+} HaloClassName;
+
+static const HaloClassName haloClassNames[] = { //from Halo Editing Kit; sorted by the class as a uint32_t for findHaloClass
+    { DELA, "ui widget definition", "ui_widget_definition" },
+    { SOUL, "ui widget collection", "ui_widget_collection" },
+    { ACTR, "actor", "actor" },
+    { ACTV, "actor variant", "actor_variant" },
+    { ANT,  "antenna", "antenna" },
+    { ANTR, "model animations", "model_animations" },
+    { BIPD, "biped", "biped" },
+    { BITM, "bitmap", "bitmap" },
+    { BOOM, "spheroid", "spheroid" },
+    { CDMG, "continuous damage effect", "continuous_damage_effect" },
+    { COLL, "model collision geometry", "model_collision_geometry" },
+    { COLO, "color table", "color_table" },
+    { CONT, "contrail", "contrail" },
+    { CTRL, "device control", "device_control" },
+    { DECA, "decal", "decal" },
+    { DEVC, "input device defaults", "input_device_defaults" },
+    { DEVI, "device", "device" },
+    { DOBC, "detail object collection", "detail_object_collection" },
+    { EFFE, "effect", "effect" },
+    { ELEC, "electricity", "lightning" },
+    { EQIP, "equipment", "equipment" },
+    { FLAG, "flag", "flag" },
+    { FOG,  "fog", "fog" },
+    { FONT, "font", "font" },
+    { FOOT, "material effects", "material_effects" },
+    { GARB, "garbage", "garbage" },
+    { GLW,  "glow", "glow" },
+    { GRHI, "grenade hud interface", "grenade_hud_interface" },
+    { HMT,  "hud message text", "hud_message_text" },
+    { HUD,  "hud number", "hud_number" },
+    { HUDG, "hud globals", "hud_globals" },
+    { ITEM, "item", "item" },
+    { ITMC, "item collection", "item_collection" },
+    { JPT,  "damage effect", "damage_effect" },
+    { LENS, "lens flare", "lens_flare" },
+    { LIFI, "device light fixture", "device_light_fixture" },
+    { LIGH, "light", "light" },
+    { LSND, "sound looping", "sound_looping" },
+    { MACH, "device machinery", "device_machine" },
+    { MATG, "game globals", "globals" },
+    { METR, "meter", "meter" },
+    { MGS2, "light volume", "light_volume" },
+    { MOD2, "gearbox model", "gbxmodel" },
+    { MODE, "model", "model" },
+    { MPLY, "multiplayer scenario description", "multiplayer_scenario_description" },
+    { NGPR, "network game preferences", "preferences_network_game" },
+    { OBJE, "object", "object" },
+    { PART, "particle", "particle" },
+    { PCTL, "particle system", "particle_system" },
+    { PHYS, "physics", "physics" },
+    { PLAC, "placeholder", "placeholder" },
+    { PPHY, "point physics", "point_physics" },
+    { PROJ, "projectile", "projectile" },
+    { RAIN, "weather", "weather_particle_system" },
+    { SBSP, "scenario structure binary space partition", "scenario_structure_bsp" },
+    { SCEN, "scenery", "scenery" },
+    { SCEX, "shader transparent chicago extended", "shader_transparent_chicago_extended" },
+    { SCHI, "shader transparent chicago", "shader_transparent_chicago" },
+    { SCNR, "scenario", "scenario" },
+    { SENV, "shader environment", "shader_environment" },
+    { SGLA, "shader transparent glass", "shader_transparent_glass" },
+    { SHDR, "shader", "shader" },
+    { SKY,  "sky", "sky" },
+    { SMET, "shader transparent meter", "shader_transparent_meter" },
+    { SND,  "sound", "sound" },
+    { SNDE, "sound environment", "sound_environment" },
+    { SOSO, "shader model", "shader_model" },
+    { SOTR, "shader transparent generic", "shader_transparent_generic" },
+    { SPLA, "shader transparent plasma", "shader_transparent_plasma" },
+    { SSCE, "sound scenery", "sound_scenery" },
+    { STR,  "string list", "string_list" },
+    { SWAT, "shader transparent water", "shader_transparent_water" },
+    { TAGC, "tag collection", "tag_collection" },
+    { TRAK, "camera track", "camera_track" },
+    { UDLG, "unit dialogue", "dialogue" },
+    { UNHI, "unit hud interface", "unit_hud_interface" },
+    { UNIT, "unit", "unit" },
+    { USTR, "unicode string list", "unicode_string_list" },
+    { VCKY, "virtual keyboard", "virtual_keyboard" },
+    { VEHI, "vehicle", "vehicle" },
+    { WEAP, "weapon", "weapon" },
+    { WIND, "wind", "wind" },
+    { WPHI, "weapon hud interface", "weapon_hud_interface" },
+};
+
+static const HaloClassName *findHaloClass(uint32_t className) { //NULL if it isn't a Halo class
+    uint32_t low = 0;
+    uint32_t high = sizeof(haloClassNames) / sizeof(*haloClassNames);
+    while(low < high) {
+        uint32_t middle = (low + high) / 2;
+        uint32_t tagClass;
+        memcpy(&tagClass, haloClassNames[middle].tagClass, sizeof(tagClass));
+        if(tagClass == className) return &haloClassNames[middle];
+        if(tagClass < className) low = middle + 1;
+        else high = middle;
+    }
+    return NULL;
+}
+
+const char *translateHaloClassToName(uint32_t className) {
+    const HaloClassName *haloClass = findHaloClass(className);
+    return haloClass ? haloClass->name : "unknown";
+}
+
+const char *translateHaloClassToExtension(uint32_t className) {
+    const HaloClassName *haloClass = findHaloClass(className);
+    return haloClass ? haloClass->extension : "unknown";
+}
+
+bool isHaloClass(uint32_t className) {
+    return findHaloClass(className) != NULL;
+}
@@ -18,6 +18,7 @@
  */
 
 #include <stdint.h>
+#include <stdbool.h>
 
 #define ACTR "rtca"
 #define ACTV "vtca"
@@ -106,4 +107,6 @@
 #ifndef deathstar_ZZTTagClasses_h
 #define deathstar_ZZTTagClasses_h
 const char *translateHaloClassToName(uint32_t className);
+const char *translateHaloClassToExtension(uint32_t className);
+bool isHaloClass(uint32_t className);
 #endif
\ No newline at end of file
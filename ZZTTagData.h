@@ -22,7 +22,7 @@
 #ifndef deathstar_ZZTTagData_h
 #define deathstar_ZZTTagData_h
 
-#pragma pack(1)
+#pragma pack(push, 1)
 
 typedef struct {
     uint16_t tagTableIndex;
@@ -51,7 +51,8 @@ typedef struct {
 	char name[0x20];
 	char builddate[0x20];
 	uint32_t type;
-    char zeroes2[0x798];
+	uint32_t crc32;
+    char zeroes2[0x794];
     uint32_t integrityFoot;
 } HaloMapHeader;
 
@@ -1039,4 +1040,6 @@ typedef struct {
     Dependency eqip; //0x1C0
 } ActvDependencies;
 
+#pragma pack(pop)
+
 #endif
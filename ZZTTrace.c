@@ -0,0 +1,160 @@
+// ZZTTrace.c
+
+/*
+ 
+ Copyright (c) 2014, Paul Whitcomb
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * Neither the name of Paul Whitcomb nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ 
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+#include "ZZTTrace.h"
+#include "ZZTParallel.h"
+
+#define TRACE_MAP_NAME_SIZE 0x40
+
+typedef struct {
+    const char *name;
+    uint64_t start;
+    uint64_t duration;
+    uint32_t thread;
+    char map[TRACE_MAP_NAME_SIZE];
+} TraceEvent;
+
+static volatile bool tracing = false;
+static char *tracePath = NULL;
+static TraceEvent *events = NULL;
+static size_t eventCount = 0;
+static size_t eventCapacity = 0;
+static uint32_t threadCount = 0;
+static uint64_t epoch = 0;
+static pthread_mutex_t traceLock = PTHREAD_MUTEX_INITIALIZER;
+
+static THREAD_LOCAL uint32_t traceThread = 0; //0 until the thread's first span
+static THREAD_LOCAL char traceMap[TRACE_MAP_NAME_SIZE];
+
+static uint64_t traceNow(void) { //microseconds, never 0
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000 + (uint64_t)now.tv_nsec / 1000 + 1;
+}
+
+void traceStart(const char *path) {
+    free(tracePath);
+    tracePath = malloc(strlen(path) + 1);
+    strcpy(tracePath, path);
+    epoch = traceNow();
+    tracing = true;
+}
+
+void traceDetach(void) {
+    if(!tracing) return;
+    size_t length = strlen(tracePath);
+    char *path = malloc(length + 0x18);
+    snprintf(path, length + 0x18, "%s.%d", tracePath, (int)getpid());
+    free(tracePath);
+    tracePath = path;
+    eventCount = 0; //the parent still has its own spans and writes them itself
+}
+
+void traceSetMap(const char *map) {
+    if(!tracing) return;
+    strncpy(traceMap, map, TRACE_MAP_NAME_SIZE - 1);
+    traceMap[TRACE_MAP_NAME_SIZE - 1] = 0;
+}
+
+const char *traceMapName(void) {
+    return traceMap;
+}
+
+TraceSpan traceBegin(const char *name) {
+    TraceSpan span;
+    span.name = name;
+    span.start = tracing ? traceNow() : 0;
+    return span;
+}
+
+void traceEnd(TraceSpan span) {
+    if(!tracing || span.start == 0) return;
+    uint64_t end = traceNow();
+    pthread_mutex_lock(&traceLock);
+    if(traceThread == 0) traceThread = ++threadCount;
+    if(eventCount == eventCapacity) {
+        size_t capacity = eventCapacity ? eventCapacity * 2 : 0x100;
+        TraceEvent *grown = realloc(events, capacity * sizeof(TraceEvent));
+        if(grown == NULL) {
+            pthread_mutex_unlock(&traceLock);
+            return;
+        }
+        events = grown;
+        eventCapacity = capacity;
+    }
+    TraceEvent *event = &events[eventCount++];
+    event->name = span.name;
+    event->start = span.start - epoch;
+    event->duration = end - span.start;
+    event->thread = traceThread;
+    memcpy(event->map, traceMap, TRACE_MAP_NAME_SIZE);
+    pthread_mutex_unlock(&traceLock);
+}
+
+static void traceWriteString(FILE *file, const char *string) {
+    fputc('"', file);
+    for(;*string;string++) {
+        unsigned char character = (unsigned char)*string;
+        if(character == '"' || character == '\\') fprintf(file, "\\%c", character);
+        else if(character < 0x20) fprintf(file, "\\u%04x", character);
+        else fputc(character, file);
+    }
+    fputc('"', file);
+}
+
+void traceFinish(void) {
+    if(!tracing) return;
+    tracing = false;
+    FILE *file = fopen(tracePath, "w");
+    if(file) {
+        int process = (int)getpid();
+        fprintf(file, "{\"traceEvents\":[\n");
+        for(size_t i=0;i<eventCount;i++) {
+            fprintf(file, "{\"name\":");
+            traceWriteString(file, events[i].name);
+            fprintf(file, ",\"cat\":\"deathstar\",\"ph\":\"X\",\"ts\":%llu,\"dur\":%llu,\"pid\":%d,\"tid\":%u,\"args\":{\"map\":", (unsigned long long)events[i].start, (unsigned long long)events[i].duration, process, events[i].thread);
+            traceWriteString(file, events[i].map);
+            fprintf(file, "}}%s\n", i + 1 < eventCount ? "," : "");
+        }
+        fprintf(file, "],\"displayTimeUnit\":\"ms\"}\n");
+        fclose(file);
+    }
+    else {
+        printf("Failed to write the trace to %s.\n", tracePath);
+    }
+    free(events);
+    free(tracePath);
+    events = NULL;
+    tracePath = NULL;
+    eventCount = 0;
+    eventCapacity = 0;
+}
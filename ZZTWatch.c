@@ -0,0 +1,380 @@
+// ZZTWatch.c
+
+/*
+ 
+ Copyright (c) 2014, Paul Whitcomb
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * Neither the name of Paul Whitcomb nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ 
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "ZZTWatch.h"
+
+#ifdef __linux__
+
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <dirent.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include "ZZTTagData.h"
+#include "ZZTPipeline.h"
+#include "ZZTArena.h"
+#include "ZZTTrace.h"
+
+#define WATCH_PATH_LENGTH 0x400
+#define WATCH_EVENT_BUFFER 0x1000
+#define WATCH_POLL_MILLISECONDS 1000
+
+typedef struct {
+    char **paths;                //ring buffer of malloc'd paths
+    uint32_t capacity;
+    uint32_t head;
+    uint32_t count;
+    bool closing;
+    pthread_mutex_t lock;
+    pthread_cond_t notEmpty;
+    pthread_cond_t notFull;
+} WatchQueue;
+
+typedef struct {
+    WatchQueue queue;
+    const char *output;
+    const MapCache *cache;
+    const char *operation;
+    ZTeamOptions zteam;
+    NameLayout nameLayout;
+    FILE *report;
+    pthread_mutex_t reportLock;  //also keeps console lines whole
+    uint32_t processed;
+    uint32_t failed;
+} WatchContext;
+
+static volatile sig_atomic_t watchStopping = 0;
+
+static void watch_stop(int signal) {
+    (void)signal;
+    watchStopping = 1;
+}
+
+static uint64_t watch_milliseconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+static bool watch_isMapName(const char *name) {
+    size_t length = strlen(name);
+    return name[0] != '.' && length > 4 && strcmp(name + length - 4, ".map") == 0;
+}
+
+static bool watch_push(WatchQueue *queue, const char *path) { //blocks while the queue is full; false if the watch is stopping
+    pthread_mutex_lock(&queue->lock);
+    while(queue->count == queue->capacity && !watchStopping) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += 1; //wake up now and then to notice signals
+        pthread_cond_timedwait(&queue->notFull, &queue->lock, &deadline);
+    }
+    bool queued = !watchStopping;
+    if(queued) {
+        queue->paths[(queue->head + queue->count) % queue->capacity] = strdup(path);
+        queue->count++;
+        pthread_cond_signal(&queue->notEmpty);
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return queued;
+}
+
+static char *watch_pop(WatchQueue *queue) { //NULL once the queue is closed and empty
+    pthread_mutex_lock(&queue->lock);
+    while(queue->count == 0 && !queue->closing) {
+        pthread_cond_wait(&queue->notEmpty, &queue->lock);
+    }
+    char *path = NULL;
+    if(queue->count > 0) {
+        path = queue->paths[queue->head];
+        queue->head = (queue->head + 1) % queue->capacity;
+        queue->count--;
+        pthread_cond_signal(&queue->notFull);
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return path;
+}
+
+static void watch_writeJSONString(FILE *file, const char *string) {
+    fputc('"', file);
+    for(const unsigned char *c = (const unsigned char *)string; *c; c++) {
+        if(*c == '"' || *c == '\\') fprintf(file, "\\%c", *c);
+        else if(*c < 0x20) fprintf(file, "\\u%04x", *c);
+        else fputc(*c, file);
+    }
+    fputc('"', file);
+}
+
+static void watch_report(WatchContext *context, const char *name, const char *status, uint32_t checksum, uint32_t tags, uint64_t milliseconds) {
+    bool failed = strcmp(status, "deprotected") != 0 && strcmp(status, "cached") != 0;
+    pthread_mutex_lock(&context->reportLock);
+    fprintf(context->report, "{\"map\":");
+    watch_writeJSONString(context->report, name);
+    fprintf(context->report, ",\"status\":\"%s\",\"checksum\":\"0x%08X\",\"tags\":%u,\"milliseconds\":%llu}\n", status, checksum, tags, (unsigned long long)milliseconds);
+    fflush(context->report);
+    if(failed) {
+        printf("%s: %s\n", name, status);
+        context->failed++;
+    }
+    else {
+        printf("%s has been saved! Checksum: 0x%08X\n", name, checksum);
+    }
+    fflush(stdout);
+    context->processed++;
+    pthread_mutex_unlock(&context->reportLock);
+}
+
+static MapData watch_deprotect(WatchContext *context, MapData map) { //the same passes as --batch
+    const MapPass *passes[MAX_MAP_PASSES];
+    uint32_t count;
+    parseMapPasses("zteam,name,checksum", passes, &count);
+    MapPipeline pipeline;
+    mapPipelineInit(&pipeline, map);
+    pipeline.zteam = context->zteam;
+    pipeline.names.layout = context->nameLayout;
+    pipeline.names.threads = 1; //the pool already keeps every processor busy
+    runMapPipeline(&pipeline, passes, count);
+    MapData final_map = pipeline.map;
+    pipeline.map.buffer = NULL;
+    mapPipelineClose(&pipeline);
+    return final_map;
+}
+
+static void watch_processMap(WatchContext *context, const char *path) {
+    const char *slash = strrchr(path, '/');
+    const char *name = slash ? slash + 1 : path;
+    traceSetMap(name);
+    uint64_t start = watch_milliseconds();
+    
+    MapData map = openMapAtPath(path);
+    if(map.error == MAP_INVALID_PATH) {
+        watch_report(context, name, "unreadable", 0, 0, watch_milliseconds() - start);
+        return;
+    }
+    else if(map.error != MAP_OK) {
+        watch_report(context, name, "invalid", 0, 0, watch_milliseconds() - start);
+        return;
+    }
+    
+    uint64_t inputHash = context->cache ? hashMap(map) : 0;
+    MapData final_map;
+    final_map.error = MAP_INVALID_PATH;
+    if(context->cache) final_map = mapCacheLookup(*context->cache, inputHash, context->operation);
+    bool cached = final_map.error == MAP_OK;
+    if(!cached) {
+        final_map = watch_deprotect(context, map);
+        if(context->cache) mapCacheStore(*context->cache, inputHash, context->operation, final_map);
+    }
+    HaloMapHeader *header = (HaloMapHeader *)final_map.buffer;
+    HaloMapIndex *index = (HaloMapIndex *)(final_map.buffer + header->indexOffset);
+    
+    //save under a hidden name first so nothing downstream picks up a partly written map
+    char temporary[WATCH_PATH_LENGTH];
+    char destination[WATCH_PATH_LENGTH];
+    snprintf(temporary, sizeof(temporary), "%s/.%s.part", context->output, name);
+    snprintf(destination, sizeof(destination), "%s/%s", context->output, name);
+    const char *status = cached ? "cached" : "deprotected";
+    if(saveMap(temporary, final_map) != 0 || rename(temporary, destination) != 0) {
+        unlink(temporary);
+        status = "unwritable";
+    }
+    watch_report(context, name, status, header->crc32, index->tagCount, watch_milliseconds() - start);
+}
+
+static void *watch_worker(void *argument) {
+    WatchContext *context = argument;
+    MapArena arena;
+    mapArenaInit(&arena, 0);
+    setDeathstarArena(&arena);
+    char *path;
+    while((path = watch_pop(&context->queue)) != NULL) {
+        watch_processMap(context, path);
+        mapArenaReset(&arena);
+        free(path);
+    }
+    setDeathstarArena(NULL);
+    mapArenaFree(&arena);
+    return NULL;
+}
+
+static bool watch_queueFile(WatchContext *context, const char *incoming, const char *name) {
+    if(!watch_isMapName(name)) return true;
+    char path[WATCH_PATH_LENGTH];
+    snprintf(path, sizeof(path), "%s/%s", incoming, name);
+    struct stat info;
+    if(stat(path, &info) != 0 || !S_ISREG(info.st_mode)) return true;
+    return watch_push(&context->queue, path);
+}
+
+static void watch_scanDirectory(WatchContext *context, const char *incoming) { //picks up maps that arrived before the watch started or while events were dropped
+    DIR *directory = opendir(incoming);
+    if(directory == NULL) return;
+    struct dirent *entry;
+    while((entry = readdir(directory)) != NULL) {
+        if(!watch_queueFile(context, incoming, entry->d_name)) break;
+    }
+    closedir(directory);
+}
+
+static bool watch_sameDirectory(const char *a, const char *b) {
+    struct stat infoA, infoB;
+    return stat(a, &infoA) == 0 && stat(b, &infoB) == 0 && infoA.st_dev == infoB.st_dev && infoA.st_ino == infoB.st_ino;
+}
+
+int watchDirectory(const char *incoming, const char *output, WatchOptions options) {
+    mkdir(output, 0777);
+    struct stat info;
+    if(stat(output, &info) != 0 || !S_ISDIR(info.st_mode)) {
+        printf("Failed to create the output directory %s.\n", output);
+        return 1;
+    }
+    if(watch_sameDirectory(incoming, output)) {
+        printf("The output directory can't be the incoming directory.\n");
+        return 1;
+    }
+    
+    int notify = inotify_init1(IN_CLOEXEC);
+    if(notify < 0 || inotify_add_watch(notify, incoming, IN_CLOSE_WRITE | IN_MOVED_TO | IN_ONLYDIR) < 0) {
+        printf("Failed to watch %s. Is it a directory?\n", incoming);
+        if(notify >= 0) close(notify);
+        return 1;
+    }
+    
+    WatchContext context;
+    memset(&context, 0, sizeof(context));
+    char reportPath[WATCH_PATH_LENGTH];
+    snprintf(reportPath, sizeof(reportPath), "%s/%s", output, WATCH_REPORT_NAME);
+    context.report = fopen(reportPath, "a");
+    if(context.report == NULL) {
+        printf("Failed to open %s for writing.\n", reportPath);
+        close(notify);
+        return 1;
+    }
+    context.output = output;
+    context.cache = options.cache;
+    context.operation = options.operation;
+    context.zteam = options.zteam;
+    context.nameLayout = options.nameLayout;
+    pthread_mutex_init(&context.reportLock, NULL);
+    context.queue.capacity = options.queueSize ? options.queueSize : WATCH_DEFAULT_QUEUE_SIZE;
+    context.queue.paths = malloc(sizeof(char *) * context.queue.capacity);
+    pthread_mutex_init(&context.queue.lock, NULL);
+    pthread_cond_init(&context.queue.notEmpty, NULL);
+    pthread_cond_init(&context.queue.notFull, NULL);
+    
+    //no SA_RESTART, so a signal wakes up poll() right away
+    struct sigaction stop, previousInterrupt, previousTerminate;
+    memset(&stop, 0, sizeof(stop));
+    stop.sa_handler = watch_stop;
+    sigemptyset(&stop.sa_mask);
+    watchStopping = 0;
+    sigaction(SIGINT, &stop, &previousInterrupt);
+    sigaction(SIGTERM, &stop, &previousTerminate);
+    
+    uint32_t workers = options.workers ? options.workers : 1;
+    pthread_t *threads = malloc(sizeof(pthread_t) * workers);
+    uint32_t started = 0;
+    for(;started<workers;started++) {
+        if(pthread_create(&threads[started], NULL, watch_worker, &context) != 0) break;
+    }
+    if(started == 0) {
+        printf("Failed to start the worker threads.\n");
+        watchStopping = 1;
+    }
+    else {
+        printf("Watching %s with %u workers. Press Ctrl+C to stop.\n", incoming, started);
+        fflush(stdout);
+        watch_scanDirectory(&context, incoming);
+    }
+    
+    union {
+        struct inotify_event event; //keeps the buffer aligned for the events read into it
+        char bytes[WATCH_EVENT_BUFFER];
+    } events;
+    while(!watchStopping) {
+        struct pollfd request;
+        request.fd = notify;
+        request.events = POLLIN;
+        request.revents = 0;
+        int ready = poll(&request, 1, WATCH_POLL_MILLISECONDS);
+        if(ready < 0 && errno != EINTR) break;
+        if(ready <= 0) continue;
+        ssize_t length = read(notify, events.bytes, sizeof(events.bytes));
+        if(length <= 0) {
+            if(length < 0 && errno == EINTR) continue;
+            break;
+        }
+        for(ssize_t offset = 0; offset < length && !watchStopping;) {
+            const struct inotify_event *event = (const struct inotify_event *)(events.bytes + offset);
+            if(event->mask & IN_Q_OVERFLOW) {
+                watch_scanDirectory(&context, incoming);
+            }
+            else if(event->mask & IN_IGNORED) {
+                printf("%s is no longer available. Stopping.\n", incoming);
+                watchStopping = 1;
+            }
+            else if(event->len > 0 && !(event->mask & IN_ISDIR)) {
+                watch_queueFile(&context, incoming, event->name);
+            }
+            offset += sizeof(struct inotify_event) + event->len;
+        }
+    }
+    
+    //maps that are already queued still get written
+    pthread_mutex_lock(&context.queue.lock);
+    context.queue.closing = true;
+    pthread_cond_broadcast(&context.queue.notEmpty);
+    pthread_mutex_unlock(&context.queue.lock);
+    for(uint32_t i=0;i<started;i++) {
+        pthread_join(threads[i], NULL);
+    }
+    
+    sigaction(SIGINT, &previousInterrupt, NULL);
+    sigaction(SIGTERM, &previousTerminate, NULL);
+    close(notify);
+    printf("Stopped watching %s. Processed %u maps, %u failed.\n", incoming, context.processed, context.failed);
+    
+    free(threads);
+    free(context.queue.paths);
+    pthread_cond_destroy(&context.queue.notFull);
+    pthread_cond_destroy(&context.queue.notEmpty);
+    pthread_mutex_destroy(&context.queue.lock);
+    pthread_mutex_destroy(&context.reportLock);
+    fclose(context.report);
+    return started == 0;
+}
+
+#else
+
+int watchDirectory(const char *incoming, const char *output, WatchOptions options) {
+    (void)incoming;
+    (void)output;
+    (void)options;
+    printf("Watch mode uses inotify and is only available on Linux.\n");
+    return 1;
+}
+
+#endif
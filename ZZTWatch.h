@@ -0,0 +1,40 @@
+// ZZTWatch.h
+
+/*
+ 
+ Copyright (c) 2014, Paul Whitcomb
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * Neither the name of Paul Whitcomb nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ 
+ */
+
+#include "ZZTDeathstar.h"
+#include "ZZTMapCache.h"
+
+#ifndef deathstar_ZZTWatch_h
+#define deathstar_ZZTWatch_h
+
+#define WATCH_DEFAULT_QUEUE_SIZE 64
+#define WATCH_REPORT_NAME "report.jsonl"
+
+typedef struct {
+    uint32_t workers;            //maps deprotected at once
+    uint32_t queueSize;          //maps waiting for a worker before the watcher stops reading events; 0 uses WATCH_DEFAULT_QUEUE_SIZE
+    const MapCache *cache;       //NULL to always deprotect
+    const char *operation;       //what results are cached under; it has to change with the options below
+    ZTeamOptions zteam;
+    NameLayout nameLayout;
+} WatchOptions;
+
+int watchDirectory(const char *incoming, const char *output, WatchOptions options); //runs until SIGINT or SIGTERM; nonzero if the watch couldn't start
+
+#endif
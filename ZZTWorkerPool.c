@@ -0,0 +1,269 @@
+// ZZTWorkerPool.c
+
+/*
+ 
+ Copyright (c) 2014, Paul Whitcomb
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * Neither the name of Paul Whitcomb nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ 
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "ZZTWorkerPool.h"
+
+#ifndef _WIN32
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include "ZZTArena.h"
+#include "ZZTTrace.h"
+
+#define POOL_POLL_MILLISECONDS 1000
+#define POOL_NO_JOB UINT32_MAX
+
+typedef struct {
+    uint32_t job;
+    PoolMapResult result;
+} PoolReply; //small enough that a pipe write of it is atomic
+
+typedef struct {
+    pid_t pid;
+    int requests;                //job indices go out here
+    int replies;                 //PoolReply records come back here
+    uint32_t job;                //POOL_NO_JOB while idle
+    uint64_t started;
+    bool timedOut;
+} PoolWorker;
+
+typedef struct {
+    const char *const *paths;
+    uint32_t count;
+    WorkerPoolOptions options;
+    PoolWorker *workers;
+} WorkerPool;
+
+static uint64_t pool_milliseconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+static bool pool_readAll(int file, void *buffer, size_t size) {
+    char *data = buffer;
+    while(size > 0) {
+        ssize_t count = read(file, data, size);
+        if(count < 0 && errno == EINTR) continue;
+        if(count <= 0) return false;
+        data += count;
+        size -= (size_t)count;
+    }
+    return true;
+}
+
+static bool pool_writeAll(int file, const void *buffer, size_t size) {
+    const char *data = buffer;
+    while(size > 0) {
+        ssize_t count = write(file, data, size);
+        if(count < 0 && errno == EINTR) continue;
+        if(count <= 0) return false;
+        data += count;
+        size -= (size_t)count;
+    }
+    return true;
+}
+
+static void pool_workerMain(WorkerPool *pool, int requests, int replies) {
+    traceDetach();
+    MapArena arena;
+    mapArenaInit(&arena, 0);
+    setDeathstarArena(&arena);
+    uint32_t job;
+    while(pool_readAll(requests, &job, sizeof(job)) && job < pool->count) {
+        PoolReply reply;
+        reply.job = job;
+        reply.result = pool->options.processMap(pool->paths[job], pool->options.context);
+        mapArenaReset(&arena);
+        if(!pool_writeAll(replies, &reply, sizeof(reply))) break;
+    }
+    traceFinish();
+    _exit(0); //the parent owns stdout's buffer
+}
+
+static bool pool_spawn(WorkerPool *pool, uint32_t index) {
+    PoolWorker *worker = &pool->workers[index];
+    int requests[2];
+    int replies[2];
+    if(pipe(requests) != 0) return false;
+    if(pipe(replies) != 0) {
+        close(requests[0]);
+        close(requests[1]);
+        return false;
+    }
+    fflush(stdout);
+    pid_t pid = fork();
+    if(pid == 0) {
+        for(uint32_t i=0;i<pool->options.workers;i++) { //another worker's pipes would hide its parent closing them
+            if(i == index || pool->workers[i].pid <= 0) continue;
+            close(pool->workers[i].requests);
+            close(pool->workers[i].replies);
+        }
+        close(requests[1]);
+        close(replies[0]);
+        pool_workerMain(pool, requests[0], replies[1]);
+    }
+    close(requests[0]);
+    close(replies[1]);
+    if(pid < 0) {
+        close(requests[1]);
+        close(replies[0]);
+        return false;
+    }
+    worker->pid = pid;
+    worker->requests = requests[1];
+    worker->replies = replies[0];
+    worker->job = POOL_NO_JOB;
+    worker->timedOut = false;
+    return true;
+}
+
+static PoolMapResult pool_reap(WorkerPool *pool, uint32_t index) { //collects a dead worker and says what happened to its map
+    PoolWorker *worker = &pool->workers[index];
+    close(worker->requests);
+    close(worker->replies);
+    int status = 0;
+    while(waitpid(worker->pid, &status, 0) < 0 && errno == EINTR);
+    worker->pid = 0;
+    PoolMapResult result;
+    result.status = worker->timedOut ? POOL_MAP_TIMED_OUT : POOL_MAP_CRASHED;
+    result.checksum = 0;
+    result.signal = WIFSIGNALED(status) ? WTERMSIG(status) : 0;
+    return result;
+}
+
+static void pool_finish(WorkerPool *pool, uint32_t job, PoolMapResult result) {
+    if(pool->options.reportResult) pool->options.reportResult(pool->paths[job], result, pool->options.context);
+}
+
+static bool pool_assign(WorkerPool *pool, uint32_t index, uint32_t job) {
+    PoolWorker *worker = &pool->workers[index];
+    for(int attempt=0;attempt<2;attempt++) { //an idle worker can still have died since its last map
+        if(worker->pid > 0 && pool_writeAll(worker->requests, &job, sizeof(job))) {
+            worker->job = job;
+            worker->started = pool_milliseconds();
+            return true;
+        }
+        if(worker->pid > 0) pool_reap(pool, index);
+        if(!pool_spawn(pool, index)) return false;
+    }
+    return false;
+}
+
+int runWorkerPool(const char *const *paths, uint32_t count, WorkerPoolOptions options) {
+    if(options.workers == 0) options.workers = 1;
+    if(options.workers > count) options.workers = count;
+    if(count == 0) return 0;
+    
+    WorkerPool pool;
+    pool.paths = paths;
+    pool.count = count;
+    pool.options = options;
+    pool.workers = calloc(options.workers, sizeof(PoolWorker));
+    struct pollfd *polls = calloc(options.workers, sizeof(struct pollfd));
+    
+    struct sigaction ignore;
+    struct sigaction previous;
+    memset(&ignore, 0, sizeof(ignore));
+    ignore.sa_handler = SIG_IGN;
+    sigemptyset(&ignore.sa_mask);
+    sigaction(SIGPIPE, &ignore, &previous); //a dead worker shows up as a failed write instead
+    
+    uint32_t started = 0;
+    for(uint32_t i=0;i<options.workers;i++) {
+        if(pool_spawn(&pool, i)) started++;
+    }
+    
+    uint32_t next = 0;
+    uint32_t finished = 0;
+    if(started > 0) {
+        for(uint32_t i=0;i<options.workers && next<count;i++) {
+            if(pool.workers[i].pid > 0 && pool_assign(&pool, i, next)) next++;
+        }
+    }
+    
+    while(started > 0 && finished < count) {
+        uint32_t busy = 0;
+        for(uint32_t i=0;i<options.workers;i++) {
+            polls[i].fd = pool.workers[i].job != POOL_NO_JOB ? pool.workers[i].replies : -1;
+            polls[i].events = POLLIN;
+            polls[i].revents = 0;
+            if(polls[i].fd >= 0) busy++;
+        }
+        if(busy == 0) break; //no worker could be started for the remaining maps
+        int ready = poll(polls, options.workers, options.timeoutSeconds ? POOL_POLL_MILLISECONDS : -1);
+        if(ready < 0 && errno != EINTR) break;
+        
+        uint64_t now = pool_milliseconds();
+        for(uint32_t i=0;i<options.workers;i++) {
+            PoolWorker *worker = &pool.workers[i];
+            if(worker->job == POOL_NO_JOB) continue;
+            if(polls[i].revents == 0) {
+                if(options.timeoutSeconds && !worker->timedOut && now - worker->started > (uint64_t)options.timeoutSeconds * 1000) {
+                    worker->timedOut = true;
+                    kill(worker->pid, SIGKILL); //its pipe closes, and the next poll reaps it
+                }
+                continue;
+            }
+            
+            uint32_t job = worker->job;
+            PoolReply reply;
+            worker->job = POOL_NO_JOB;
+            if(!worker->timedOut && pool_readAll(worker->replies, &reply, sizeof(reply)) && reply.job == job) {
+                pool_finish(&pool, job, reply.result);
+            }
+            else {
+                pool_finish(&pool, job, pool_reap(&pool, i));
+                if(!pool_spawn(&pool, i)) started--;
+            }
+            finished++;
+            if(worker->pid > 0 && next < count && pool_assign(&pool, i, next)) next++;
+        }
+    }
+    
+    for(uint32_t i=0;i<options.workers;i++) { //closing the request pipes lets the workers exit
+        if(pool.workers[i].pid <= 0) continue;
+        close(pool.workers[i].requests);
+        close(pool.workers[i].replies);
+        while(waitpid(pool.workers[i].pid, NULL, 0) < 0 && errno == EINTR);
+    }
+    sigaction(SIGPIPE, &previous, NULL);
+    free(polls);
+    free(pool.workers);
+    return finished == count ? 0 : 1;
+}
+
+#else
+
+int runWorkerPool(const char *const *paths, uint32_t count, WorkerPoolOptions options) { //no fork, so maps run in this process without isolation
+    for(uint32_t i=0;i<count;i++) {
+        PoolMapResult result = options.processMap(paths[i], options.context);
+        if(options.reportResult) options.reportResult(paths[i], result, options.context);
+    }
+    return 0;
+}
+
+#endif
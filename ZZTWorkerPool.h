@@ -0,0 +1,54 @@
+// ZZTWorkerPool.h
+
+/*
+ 
+ Copyright (c) 2014, Paul Whitcomb
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * Neither the name of Paul Whitcomb nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ 
+ */
+
+#include "ZZTDeathstar.h"
+
+#ifndef deathstar_ZZTWorkerPool_h
+#define deathstar_ZZTWorkerPool_h
+
+typedef enum {
+    POOL_MAP_SAVED,
+    POOL_MAP_CACHED,
+    POOL_MAP_INVALID_PATH,
+    POOL_MAP_INVALID,
+    POOL_MAP_UNWRITABLE,
+    POOL_MAP_CRASHED,            //the worker died while it had the map
+    POOL_MAP_TIMED_OUT           //the worker was killed after timeoutSeconds
+} PoolMapStatus;
+
+typedef struct {
+    PoolMapStatus status;
+    uint32_t checksum;
+    int signal;                  //what killed the worker, for POOL_MAP_CRASHED; 0 if it exited
+} PoolMapResult;
+
+typedef PoolMapResult (*PoolMapFunction)(const char *path, void *context); //runs in a worker process
+typedef void (*PoolResultFunction)(const char *path, PoolMapResult result, void *context); //runs in the calling process as each map finishes
+
+typedef struct {
+    uint32_t workers;            //processes forked up front, and again whenever one dies
+    uint32_t timeoutSeconds;     //0 lets a map take as long as it needs
+    PoolMapFunction processMap;
+    PoolResultFunction reportResult;
+    void *context;               //passed to both; the workers get a copy made when they were forked
+} WorkerPoolOptions;
+
+int runWorkerPool(const char *const *paths, uint32_t count, WorkerPoolOptions options); //nonzero if the pool couldn't start
+
+#endif
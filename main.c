@@ -31,6 +31,33 @@
 
 #include "ZZTDeathstar.h"
 #include "ZZTTagData.h"
+#include "ZZTEngine.h"
+#include "ZZTMapCache.h"
+#include "ZZTChecksum.h"
+#include "ZZTArena.h"
+#include "ZZTParallel.h"
+#include "ZZTExtract.h"
+#include "ZZTStrip.h"
+#include "ZZTTrace.h"
+#include "ZZTDiff.h"
+#include "ZZTWatch.h"
+#include "ZZTScan.h"
+#include "ZZTJournal.h"
+#include "ZZTCoverage.h"
+#include "ZZTWorkerPool.h"
+#include "ZZTPipeline.h"
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#define STDIN_FILENO 0
+#define STDOUT_FILENO 1
+#define STDERR_FILENO 2
+#define dup _dup
+#define dup2 _dup2
+#else
+#include <unistd.h>
+#endif
 
 #define PROG_VERSION "Deathstar 1.0a12"
 #define PROG_CREATED "9th January, 2014"
@@ -44,15 +71,274 @@ static inline uint32_t swapEndian32(uint32_t integer) {
     return *(uint32_t *)swappedValue;
 }
 
+static MapCache cache = { NULL, MAP_CACHE_DEFAULT_LIMIT };
+static uint32_t threads = 0; //0 uses every processor
+static bool sweep = false;
+static bool locality = false;
+static bool compactNames = false; //names are written over the original name strings, which relies on spotting name offsets in tag data
+static bool isolate = false; //--batch runs each map in a pool of worker processes
+static uint32_t timeoutSeconds = 0;
+static const char *deprotectOperation = "deprotect"; //cache keys, which change with --sweep and --compact-names
+static const char *zteamOperation = "zteam";
+static const char *nameOperation = "name";
+static const char *outputPath = NULL; //--output; NULL saves over the input map
+static int mapOutput = STDOUT_FILENO; //where maps saved to "-" go
+
+static MapData openMapArgument(const char *path) { //"-" reads standard input
+    if(strcmp(path,"-") == 0) {
+#ifdef _WIN32
+        _setmode(STDIN_FILENO, _O_BINARY);
+#endif
+        return openMapFromDescriptor(STDIN_FILENO);
+    }
+    return openMapAtPath(path);
+}
+
+static int saveMapArgument(const char *path, MapData map) { //"-" writes to standard output
+    if(strcmp(path,"-") == 0) return saveMapToDescriptor(mapOutput, map);
+    return saveMap(path, map);
+}
+
+static const char *mapDestination(const char *input) {
+    return outputPath ? outputPath : input;
+}
+
+static bool savesMap(const char *command, const char *argument) {
+    if(strcmp(command,"--passes") == 0) {
+        const MapPass *passes[MAX_MAP_PASSES];
+        uint32_t count;
+        if(parseMapPasses(argument, passes, &count)) return false;
+        for(uint32_t i=0;i<count;i++) {
+            if(passes[i] == findMapPass("save")) return true;
+        }
+        return false;
+    }
+    return strcmp(command,"--deprotect") == 0 || strcmp(command,"--zteam") == 0 || strcmp(command,"--name") == 0 || strcmp(command,"--merge") == 0 || strcmp(command,"--strip") == 0;
+}
+
+static void moveMessagesToStandardError(void) { //keeps progress messages out of a map written to standard output
+    fflush(stdout);
+    mapOutput = dup(STDOUT_FILENO);
+    dup2(STDERR_FILENO, STDOUT_FILENO);
+#ifdef _WIN32
+    _setmode(mapOutput, _O_BINARY);
+#endif
+}
+
+static bool saveCachedResult(const char *path, uint64_t hash, const char *operation) { //true if the cache already had this result
+    if(cache.directory == NULL) return false;
+    MapData cached = mapCacheLookup(cache, hash, operation);
+    if(cached.error != MAP_OK) return false;
+    if(saveMapArgument(path, cached) == 0)
+        printf("Completed. Map has been saved from the cache! Checksum: 0x%08X\n",((HaloMapHeader *)cached.buffer)->crc32);
+    else
+        printf("Failed to save map. It might be read-only.\n");
+    mapClose(&cached);
+    return true;
+}
+
+static void printJSONString(const char *string) {
+    if(string == NULL) {
+        printf("null");
+        return;
+    }
+    putchar('"');
+    for(;*string;string++) {
+        unsigned char character = (unsigned char)*string;
+        if(character == '"' || character == '\\') printf("\\%c",character);
+        else if(character < 0x20) printf("\\u%04x",character);
+        else putchar(character);
+    }
+    putchar('"');
+}
+
+static void printJSONClass(uint32_t tagClass) { //classes are stored backwards
+    char name[5];
+    for(int i=0;i<4;i++) {
+        name[i] = ((char *)&tagClass)[3 - i];
+    }
+    name[4] = 0;
+    printJSONString(name);
+}
+
+static ZTeamOptions zteamOptions(void) {
+    ZTeamOptions options;
+    options.sweepDependencies = sweep;
+    options.localityOrder = locality;
+    return options;
+}
+
+static void pipelineOptions(MapPipeline *pipeline) {
+    pipeline->zteam = zteamOptions();
+    pipeline->names.layout = compactNames ? NAME_LAYOUT_COMPACT : NAME_LAYOUT_APPEND;
+    pipeline->names.threads = threads ? threads : processorCount();
+}
+
+static MapData runPasses(MapData map, const char *list) { //the map belongs to the passes, which may change it in place
+    const MapPass *passes[MAX_MAP_PASSES];
+    uint32_t count;
+    parseMapPasses(list, passes, &count);
+    MapPipeline pipeline;
+    mapPipelineInit(&pipeline, map);
+    pipelineOptions(&pipeline);
+    runMapPipeline(&pipeline, passes, count);
+    MapData result = pipeline.map;
+    pipeline.map.buffer = NULL;
+    mapPipelineClose(&pipeline);
+    return result;
+}
+
+static PoolMapResult batchMap(const char *path, void *context) {
+    (void)context;
+    PoolMapResult result;
+    result.checksum = 0;
+    result.signal = 0;
+    traceSetMap(path);
+    MapData map = openMapAtPath(path);
+    if(map.error != MAP_OK) {
+        result.status = map.error == MAP_INVALID_PATH ? POOL_MAP_INVALID_PATH : POOL_MAP_INVALID;
+        return result;
+    }
+    uint64_t inputHash = cache.directory ? hashMap(map) : 0;
+    MapData final_map;
+    final_map.error = MAP_INVALID_PATH;
+    if(cache.directory) final_map = mapCacheLookup(cache, inputHash, deprotectOperation);
+    result.status = final_map.error == MAP_OK ? POOL_MAP_CACHED : POOL_MAP_SAVED;
+    if(result.status == POOL_MAP_SAVED) {
+        final_map = runPasses(map, "zteam,name,checksum");
+        if(cache.directory) mapCacheStore(cache, inputHash, deprotectOperation, final_map);
+    }
+    else {
+        mapClose(&map);
+    }
+    result.checksum = ((HaloMapHeader *)final_map.buffer)->crc32;
+    if(saveMapReplacing(path, final_map) != 0) result.status = POOL_MAP_UNWRITABLE; //a worker killed here leaves the map alone
+    mapClose(&final_map);
+    return result;
+}
+
+static void batchReport(const char *path, PoolMapResult result, void *context) {
+    int *completed = context;
+    switch(result.status) {
+        case POOL_MAP_SAVED:
+            printf("%s has been saved! Checksum: 0x%08X\n",path,result.checksum);
+            (*completed)++;
+            break;
+        case POOL_MAP_CACHED:
+            printf("%s has been saved from the cache! Checksum: 0x%08X\n",path,result.checksum);
+            (*completed)++;
+            break;
+        case POOL_MAP_INVALID_PATH:
+            printf("Failed to open map at %s. Invalid path?\n",path);
+            break;
+        case POOL_MAP_INVALID:
+            printf("Failed to open map at %s. Path is valid, but map isn't.\n",path);
+            break;
+        case POOL_MAP_UNWRITABLE:
+            printf("Failed to save %s. It might be read-only.\n",path);
+            break;
+        case POOL_MAP_CRASHED:
+            printf("Deprotecting %s crashed its worker (signal %d). The map was left alone.\n",path,result.signal);
+            break;
+        case POOL_MAP_TIMED_OUT:
+            printf("Deprotecting %s took longer than %u seconds. The map was left alone.\n",path,timeoutSeconds);
+            break;
+    }
+    fflush(stdout);
+}
+
 int main(int argc, const char * argv[])
 {
+    while(argc > 3) {
+        if(strcmp(argv[1],"--sweep") == 0) {
+            sweep = true;
+            deprotectOperation = compactNames ? "deprotect-sweep-compact" : "deprotect-sweep";
+            zteamOperation = "zteam-sweep";
+            argv++;
+            argc--;
+            continue;
+        }
+        else if(strcmp(argv[1],"--compact-names") == 0) {
+            compactNames = true;
+            deprotectOperation = sweep ? "deprotect-sweep-compact" : "deprotect-compact";
+            nameOperation = "name-compact";
+            argv++;
+            argc--;
+            continue;
+        }
+        else if(strcmp(argv[1],"--locality") == 0) {
+            locality = true;
+            argv++;
+            argc--;
+            continue;
+        }
+        else if(strcmp(argv[1],"--isolate") == 0) {
+            isolate = true;
+            argv++;
+            argc--;
+            continue;
+        }
+        else if(strcmp(argv[1],"--timeout") == 0) {
+            timeoutSeconds = (uint32_t)strtoul(argv[2],NULL,10);
+        }
+        else if(strcmp(argv[1],"--cache") == 0) {
+            cache.directory = argv[2];
+        }
+        else if(strcmp(argv[1],"--cache-limit") == 0) {
+            cache.maxBytes = strtoull(argv[2],NULL,10) * 0x100000;
+        }
+        else if(strcmp(argv[1],"--threads") == 0) {
+            threads = (uint32_t)strtoul(argv[2],NULL,10);
+        }
+        else if(strcmp(argv[1],"--output") == 0) {
+            outputPath = argv[2];
+        }
+        else if(strcmp(argv[1],"--trace") == 0) {
+            traceStart(argv[2]);
+            atexit(traceFinish);
+        }
+        else {
+            break;
+        }
+        argv += 2;
+        argc -= 2;
+    }
+    
+    if(argc > 2) {
+        const char *mapPath = strcmp(argv[1],"--passes") == 0 && argc > 3 ? argv[3] : argv[2];
+        traceSetMap(mapPath);
+        if(savesMap(argv[1], argv[2]) && strcmp(mapDestination(mapPath),"-") == 0) {
+            moveMessagesToStandardError();
+        }
+    }
+    
     if(argc == 1 || strcmp(argv[1],"--help") == 0) {
         if(argc <= 2) {
             printf("Deprotection\n");
             printf("deathstar --deprotect <map> [maps...] ; Deprotect map at path.\n");
             printf("deathstar --zteam <map> ; Only remove zteam protection.\n");
+            printf("deathstar --batch <map> [maps...] ; Deprotect many maps in one process.\n");
+            printf("deathstar --passes <pass,pass...> <map> ; Run passes over the map in order.\n");
             printf("deathstar --name <map> [maps...]  ; Rename all tags to generic names.\n");
             printf("deathstar --preview <map>  ; Removes zteam protection without saving map.\n");
+            printf("deathstar --patch <map>  ; List zteam's changes as JSON lines.\n");
+            printf("deathstar --coverage <map>  ; Report which tags zteam reaches.\n");
+            printf("deathstar --cache <dir> <command> ; Reuse earlier results for identical maps.\n");
+            printf("deathstar --checksum <map> ; Calculate the map's checksum.\n");
+            printf("deathstar --threads <count> <command> ; Limit how many threads are used.\n");
+            printf("deathstar --trace <file> <command> ; Record a timeline of the work.\n");
+            printf("deathstar --sweep <command> ; Also recover tags the walkers don't reach.\n");
+            printf("deathstar --locality <command> ; Visit tags in the order they are stored.\n");
+            printf("deathstar --compact-names <command> ; Write new names over the original ones.\n");
+            printf("deathstar --isolate <command> ; Run --batch maps in separate worker processes.\n");
+            printf("deathstar --timeout <seconds> <command> ; Give up on an isolated map after this long.\n");
+            printf("deathstar --output <map> <command> ; Save the map somewhere else, or - for standard output.\n");
+            printf("deathstar --extract <map> <directory> ; Write each tag to its own file.\n");
+            printf("deathstar --strip <map> ; Remove tags nothing refers to.\n");
+            printf("deathstar --merge <map> [--keep-clones] ; Merge identical tags.\n");
+            printf("deathstar --diff <old map> <new map> ; List the tags that changed.\n");
+            printf("deathstar --watch <incoming> <output> ; Deprotect maps as they arrive.\n");
+            printf("deathstar --scan <map> [maps...] ; Check whether maps look protected.\n");
             printf("\n");
             printf("Information\n");
             printf("deathstar --help [--argument]; View this list, or help on an argument.\n");
@@ -92,12 +378,169 @@ int main(int argc, const char * argv[])
             printf("Use deathstar --help --name for information on name.\n");
             printf("Use deathstar --help --zteam for information on zteam.\n");
         }
+        else if(strcmp(argv[2],"--cache") == 0) {
+            printf("Syntax: deathstar --cache <dir> [--cache-limit <MiB>] <command>\n\n");
+            printf("Death Star will look up the map's contents in the cache\n");
+            printf("directory before deprotecting it, and store new results there.\n");
+            printf("The least recently used results are removed once the cache\n");
+            printf("grows past the limit (1024 MiB by default).\n\n");
+            printf("Works with --deprotect, --zteam and --name.\n");
+        }
+        else if(strcmp(argv[2],"--trace") == 0) {
+            printf("Syntax: deathstar --trace <file> <command>\n\n");
+            printf("Records how long loading, each part of deprotection and saving\n");
+            printf("take for each map and thread, and writes them to the file as\n");
+            printf("Chrome trace JSON. Open it in chrome://tracing or Perfetto.\n");
+        }
+        else if(strcmp(argv[2],"--sweep") == 0) {
+            printf("Syntax: deathstar --sweep <command>\n\n");
+            printf("After z-team deprotection follows the fields it knows, every\n");
+            printf("Dependency block in the tag data is found and used to recover\n");
+            printf("the class of any tag that is still obfuscated. This catches\n");
+            printf("tags only referenced from fields Death Star doesn't know, at\n");
+            printf("the cost of one pass over the tag data.\n");
+        }
+        else if(strcmp(argv[2],"--output") == 0) {
+            printf("Syntax: deathstar --output <map> <command>\n\n");
+            printf("Saves the result of --deprotect, --zteam, --name, --merge or --strip\n");
+            printf("to another path instead of over the input map. A map path of - reads\n");
+            printf("the map from standard input or writes it to standard output, so\n");
+            printf("deathstar can sit in a pipeline. Without --output, a map read from\n");
+            printf("standard input is written to standard output. While a map is being\n");
+            printf("written to standard output, messages go to standard error.\n");
+        }
+        else if(strcmp(argv[2],"--isolate") == 0 || strcmp(argv[2],"--timeout") == 0) {
+            printf("Syntax: deathstar --isolate [--timeout <seconds>] --batch <map> [maps...]\n\n");
+            printf("Starts one worker process per thread before the batch begins, and\n");
+            printf("hands each worker the next map whenever it finishes one. A map that\n");
+            printf("crashes its worker, or runs past the timeout, is reported and left\n");
+            printf("alone, and a new worker takes the dead one's place.\n");
+        }
+        else if(strcmp(argv[2],"--locality") == 0) {
+            printf("Syntax: deathstar --locality <command>\n\n");
+            printf("Z-team deprotection gathers the tags referenced by each palette\n");
+            printf("and dependency list, and visits them in the order their data is\n");
+            printf("stored instead of the order they are listed. This can help on\n");
+            printf("maps too large for the processor's cache. The result is the same.\n");
+        }
+        else if(strcmp(argv[2],"--compact-names") == 0) {
+            printf("Syntax: deathstar --compact-names <command>\n\n");
+            printf("Name deprotection appends the new names to the end of the map by\n");
+            printf("default. This writes them over the original name strings instead,\n");
+            printf("so the map doesn't grow. Tags that store name offsets of their own\n");
+            printf("are found by looking for them in the tag data, and a value that\n");
+            printf("only looks like a name offset would be changed too.\n");
+        }
+        else if(strcmp(argv[2],"--threads") == 0) {
+            printf("Syntax: deathstar --threads <count> <command>\n\n");
+            printf("Name deprotection generates names on every processor by\n");
+            printf("default. Use 1 to keep everything on one thread.\n");
+        }
+        else if(strcmp(argv[2],"--diff") == 0) {
+            printf("Syntax: deathstar --diff <old map> <new map>\n\n");
+            printf("Compares the maps tag by tag and prints one JSON record per\n");
+            printf("line for each tag that was added, removed, reclassified,\n");
+            printf("renamed or whose data changed, followed by a summary record.\n");
+            printf("Tags are paired by name and class, so moved tags still match;\n");
+            printf("the rest are paired by tag ID.\n");
+        }
+        else if(strcmp(argv[2],"--merge") == 0) {
+            printf("Syntax: deathstar --merge <map> [--keep-clones]\n\n");
+            printf("Finds tags with identical data, ignoring names and where their\n");
+            printf("blocks are stored, and points every reference to one copy.\n");
+            printf("The clones are then stripped unless --keep-clones is used.\n\n");
+            printf("Use deathstar --help --strip for information on strip.\n");
+        }
+        else if(strcmp(argv[2],"--strip") == 0) {
+            printf("Syntax: deathstar --strip <map>\n\n");
+            printf("Removes tags that can't be reached from the scenario, the\n");
+            printf("globals, or the shared ui and sound tags, then packs the\n");
+            printf("remaining tag data together.\n\n");
+            printf("Reachability and pointer fixing are heuristic, so keep a copy\n");
+            printf("of the original map. The map is left alone if a kept tag\n");
+            printf("points into data that would be removed.\n");
+        }
+        else if(strcmp(argv[2],"--extract") == 0) {
+            printf("Syntax: deathstar --extract <map> <directory>\n\n");
+            printf("Writes the metadata of each tag to <directory>/<name>.<class>,\n");
+            printf("using the names and classes currently in the map and the\n");
+            printf("tag file extensions of the Halo Editing Kit. Deprotect the\n");
+            printf("map first if they are obfuscated. Tags that share a name and\n");
+            printf("class get their index added, as in <name>_<index>.<class>.\n\n");
+            printf("Tags are written on every processor unless --threads is used.\n");
+        }
+        else if(strcmp(argv[2],"--watch") == 0) {
+            printf("Syntax: deathstar --watch <incoming> <output>\n\n");
+            printf("Waits for .map files to be written or moved into <incoming>\n");
+            printf("and deprotects each one into <output>, along with a line in\n");
+            printf("<output>/report.jsonl. Maps already in <incoming> are done first.\n\n");
+            printf("One map is deprotected per processor at a time unless --threads\n");
+            printf("is used. Press Ctrl+C to stop after the queued maps are saved.\n");
+            printf("Only available on Linux.\n");
+        }
+        else if(strcmp(argv[2],"--scan") == 0) {
+            printf("Syntax: deathstar --scan <map> [maps...]\n\n");
+            printf("Reads only the header and the tag array of each map, and prints\n");
+            printf("one JSON record per line with its version, tag and class counts,\n");
+            printf("and the signs of protection that were found:\n\n");
+            printf("unknown_classes: tags whose class isn't a Halo class\n");
+            printf("mismatched_classes: tags whose class disagrees with its parent classes\n");
+            printf("invalid_name_offsets: tags whose name is outside the map\n");
+            printf("names_outside_meta: tags whose name is outside the tag data\n\n");
+            printf("A map that shows none of these can still have obfuscated names,\n");
+            printf("or classes that only its references would reveal.\n");
+        }
+        else if(strcmp(argv[2],"--checksum") == 0) {
+            printf("Syntax: deathstar --checksum <map>\n\n");
+            printf("Calculates the CRC32 checksum of the map's BSP, model and tag\n");
+            printf("data, and compares it to the one stored in the header.\n\n");
+            printf("--deprotect, --zteam and --name store the new checksum in the\n");
+            printf("header of the maps they save.\n");
+        }
+        else if(strcmp(argv[2],"--batch") == 0) {
+            printf("Syntax: deathstar --batch <map> [maps...]\n\n");
+            printf("Death Star will deprotect each map in turn, like --deprotect.\n");
+            printf("All scratch memory for a map comes from one arena that is\n");
+            printf("reset before the next map, so memory use stays flat.\n");
+            printf("Use --isolate to keep a map that crashes from stopping the batch.\n\n");
+            printf("Use deathstar --help --deprotect for information on deprotect.\n");
+        }
         else if(strcmp(argv[2],"--preview") == 0) {
             printf("Syntax: deathstar --preview <map>\n\n");
             printf("Death Star will do z-team deprotection, but it won't save\n");
             printf("the map. Instead, it will output the results.\n\n");
             printf("Use deathstar --help --zteam for information on zteam.\n");
         }
+        else if(strcmp(argv[2],"--passes") == 0) {
+            printf("Syntax: deathstar --passes <pass,pass...> <map>\n\n");
+            printf("Runs the passes in order over one copy of the map in memory:\n\n");
+            printf("zteam: restore tag classes, in place\n");
+            printf("name: rename tags to generic names\n");
+            printf("merge: point references to identical tags at one of them\n");
+            printf("strip: remove tags nothing refers to\n");
+            printf("checksum: update the checksum in the header\n");
+            printf("save: save the map over itself, or to --output\n\n");
+            printf("A pass is skipped if nothing it reads changed since it last ran.\n");
+            printf("--deprotect is the same as --passes zteam,name,checksum,save.\n");
+        }
+        else if(strcmp(argv[2],"--coverage") == 0) {
+            printf("Syntax: deathstar --coverage <map>\n\n");
+            printf("Runs z-team deprotection without saving, and prints one JSON\n");
+            printf("record for each tag it never reached, then a summary of how\n");
+            printf("every tag was reached, for the whole map and for each class:\n\n");
+            printf("graph: from the scenario or globals\n");
+            printf("collection: only from a tagc or Soul\n");
+            printf("sweep: only from the dependency sweep (see --sweep)\n");
+            printf("skipped: matg, and tags stored in bitmaps.map or sounds.map\n");
+            printf("unreached: nothing zteam follows refers to it\n");
+        }
+        else if(strcmp(argv[2],"--patch") == 0) {
+            printf("Syntax: deathstar --patch <map>\n\n");
+            printf("Like --preview, but prints one JSON record per change with the\n");
+            printf("tag, the file offset of the field, and its old and new value.\n");
+            printf("Writing each new value at its offset does what --zteam does,\n");
+            printf("and writing the old values back undoes it.\n");
+        }
         else {
             printf("Unsupported help topic.\n");
         }
@@ -109,46 +552,391 @@ int main(int argc, const char * argv[])
             printf("Use deathstar --help --preview for more information.\n");
             return 0;
         }
-        MapData map = openMapAtPath(argv[2]);
+        MapData map = openMapArgument(argv[2]);
         if(map.error == MAP_INVALID_PATH) {
             printf("Failed to open map at %s. Invalid path?\n",argv[2]);
             return 0;
         }
-        else if(map.error == MAP_INVALID_INDEX_POINTER) {
+        else if(map.error != MAP_OK) {
             printf("Failed to open map. Path is valid, but map isn't.\n");
             return 0;
         }
-        MapData final_map = zteam_deprotect(map);
-        
-        HaloMapHeader *header = ((HaloMapHeader *)final_map.buffer);
-        HaloMapIndex *index = (HaloMapIndex *)(final_map.buffer + header->indexOffset);
-        uint32_t mapMagic = 0x40440000 - header->indexOffset;
-        
-        uint32_t tagsOffset = index->tagIndexOffset - mapMagic;
-        
-        MapTag *tagsOriginal = (MapTag *)(map.buffer + tagsOffset);
-        MapTag *tagsModified = (MapTag *)(final_map.buffer + tagsOffset);
+        MapJournal changes = zteam_deprotectJournal(map, zteamOptions());
+        if(changes.incomplete) {
+            printf("Ran out of memory while recording the changes.\n");
+            freeMapJournal(&changes);
+            mapClose(&map);
+            return 0;
+        }
+        mapJournalCompact(&changes);
         
-        bool modification = false;
+        HaloMapHeader *header = ((HaloMapHeader *)map.buffer);
+        HaloMapIndex *index = (HaloMapIndex *)(map.buffer + header->indexOffset);
+        uint32_t mapMagic = haloMapMagic(header);
+        MapTag *tags = (MapTag *)(map.buffer + index->tagIndexOffset - mapMagic);
         
-        for(uint32_t i=0;i<index->tagCount;i++) {
-            if(tagsModified[i].classA != tagsOriginal[i].classA) {
-                char *classOriginal = calloc(5,1);
-                char *classModified = calloc(5,1);
-                uint32_t class = swapEndian32(tagsOriginal[i].classA);
-                memcpy(classOriginal,&class,4);
-                class = swapEndian32(tagsModified[i].classA);
-                memcpy(classModified,&class,4);
-                printf("%s.%s -> %s\n",(char *)header + tagsModified[i].nameOffset - mapMagic,classOriginal,classModified);
-                free(classOriginal);
-                free(classModified);
-                modification = true;
-            }
+        for(uint32_t i=0;i<changes.count;i++) {
+            MapJournalEntry *entry = &changes.entries[i];
+            char classOriginal[5] = {0};
+            char classModified[5] = {0};
+            uint32_t class = swapEndian32(entry->oldValue);
+            memcpy(classOriginal,&class,4);
+            class = swapEndian32(entry->newValue);
+            memcpy(classModified,&class,4);
+            printf("%s.%s -> %s\n",(char *)header + tags[entry->tag].nameOffset - mapMagic,classOriginal,classModified);
         }
-        if(!modification) {
+        if(changes.count == 0) {
             printf("No changes were made.\n");
         }
-        
+        freeMapJournal(&changes);
+        mapClose(&map);
+    }
+    else if(strcmp(argv[1],"--patch") == 0) {
+        if(argc != 3) {
+            printf("Syntax: deathstar --patch <map>\n");
+            printf("Use deathstar --help --patch for more information.\n");
+            return 0;
+        }
+        MapData map = openMapArgument(argv[2]);
+        if(map.error == MAP_INVALID_PATH) {
+            printf("Failed to open map at %s. Invalid path?\n",argv[2]);
+            return 0;
+        }
+        else if(map.error != MAP_OK) {
+            printf("Failed to open map. Path is valid, but map isn't.\n");
+            return 0;
+        }
+        MapJournal changes = zteam_deprotectJournal(map, zteamOptions());
+        if(changes.incomplete) { //a partial patch would look like a complete one
+            fprintf(stderr, "Ran out of memory while recording the changes.\n");
+            freeMapJournal(&changes);
+            mapClose(&map);
+            return 1;
+        }
+        mapJournalCompact(&changes);
+        for(uint32_t i=0;i<changes.count;i++) {
+            MapJournalEntry *entry = &changes.entries[i];
+            printf("{\"tag\":%u,\"field\":\"class\",\"offset\":%u,\"old\":",entry->tag,mapJournalOffset(map, entry));
+            printJSONClass(entry->oldValue);
+            printf(",\"new\":");
+            printJSONClass(entry->newValue);
+            printf("}\n");
+        }
+        printf("{\"summary\":{\"changes\":%u}}\n",changes.count);
+        freeMapJournal(&changes);
+        mapClose(&map);
+        return 0;
+    }
+    else if(strcmp(argv[1],"--passes") == 0) {
+        if(argc != 4) {
+            printf("Syntax: deathstar --passes <pass,pass...> <map>\n");
+            printf("Use deathstar --help --passes for more information.\n");
+            return 0;
+        }
+        const MapPass *passes[MAX_MAP_PASSES];
+        uint32_t count;
+        const char *error = parseMapPasses(argv[2], passes, &count);
+        if(error) {
+            printf("%s\n",error);
+            return 0;
+        }
+        MapData map = openMapArgument(argv[3]);
+        if(map.error == MAP_INVALID_PATH) {
+            printf("Failed to open map at %s. Invalid path?\n",argv[3]);
+            return 0;
+        }
+        else if(map.error != MAP_OK) {
+            printf("Failed to open map. Path is valid, but map isn't.\n");
+            return 0;
+        }
+        MapPipeline pipeline;
+        mapPipelineInit(&pipeline, map);
+        pipelineOptions(&pipeline);
+        pipeline.savePath = mapDestination(argv[3]);
+        if(strcmp(pipeline.savePath,"-") == 0) pipeline.saveDescriptor = mapOutput;
+        const MapPass *failed = runMapPipeline(&pipeline, passes, count);
+        if(failed == findMapPass("save"))
+            printf("Failed to save map. It might be read-only.\n");
+        else if(failed)
+            printf("The %s pass failed.\n",failed->name);
+        else
+            printf("Completed %u passes (%u skipped). Checksum: 0x%08X\n",pipeline.ran,pipeline.skipped,((HaloMapHeader *)pipeline.map.buffer)->crc32);
+        mapPipelineClose(&pipeline);
+        return 0;
+    }
+    else if(strcmp(argv[1],"--coverage") == 0) {
+        if(argc != 3) {
+            printf("Syntax: deathstar --coverage <map>\n");
+            printf("Use deathstar --help --coverage for more information.\n");
+            return 0;
+        }
+        MapData map = openMapArgument(argv[2]);
+        if(map.error == MAP_INVALID_PATH) {
+            printf("Failed to open map at %s. Invalid path?\n",argv[2]);
+            return 0;
+        }
+        else if(map.error != MAP_OK) {
+            printf("Failed to open map. Path is valid, but map isn't.\n");
+            return 0;
+        }
+        MapCoverage coverage = zteam_coverage(map, zteamOptions());
+        HaloMapHeader *header = (HaloMapHeader *)map.buffer;
+        HaloMapIndex *index = (HaloMapIndex *)(map.buffer + header->indexOffset);
+        uint32_t mapMagic = haloMapMagic(header);
+        MapTag *tags = (MapTag *)(map.buffer + index->tagIndexOffset - mapMagic);
+        for(uint32_t i=0;i<coverage.unreachedCount;i++) {
+            uint32_t tag = coverage.unreached[i];
+            uint32_t nameOffset = tags[tag].nameOffset - mapMagic;
+            bool nameInMap = nameOffset < map.length && memchr(map.buffer + nameOffset, 0, map.length - nameOffset) != NULL;
+            printf("{\"unreached\":%u,\"class\":",tag);
+            printJSONClass(tags[tag].classA);
+            printf(",\"name\":");
+            printJSONString(nameInMap ? map.buffer + nameOffset : NULL);
+            printf("}\n");
+        }
+        const char *kinds[TAG_COVERAGE_KINDS] = { "unreached", "graph", "collection", "sweep", "skipped" };
+        printf("{\"summary\":{\"tags\":%u",coverage.tagCount);
+        for(int kind=0;kind<TAG_COVERAGE_KINDS;kind++) {
+            printf(",\"%s\":%u",kinds[kind],coverage.counts[kind]);
+        }
+        printf(",\"classes\":{");
+        for(uint32_t c=0;c<coverage.classCount;c++) {
+            if(c > 0) putchar(',');
+            printJSONClass(coverage.classes[c].tagClass);
+            putchar(':');
+            for(int kind=0;kind<TAG_COVERAGE_KINDS;kind++) {
+                printf("%s\"%s\":%u",kind == 0 ? "{" : ",",kinds[kind],coverage.classes[c].counts[kind]);
+            }
+            putchar('}');
+        }
+        printf("}}}\n");
+        freeMapCoverage(&coverage);
+        mapClose(&map);
+        return 0;
+    }
+    else if(strcmp(argv[1],"--checksum") == 0) {
+        if(argc != 3) {
+            printf("Syntax: deathstar --checksum <map>\n");
+            printf("Use deathstar --help --checksum for more information.\n");
+            return 0;
+        }
+        MapData map = openMapArgument(argv[2]);
+        if(map.error == MAP_INVALID_PATH) {
+            printf("Failed to open map at %s. Invalid path?\n",argv[2]);
+            return 0;
+        }
+        else if(map.error != MAP_OK) {
+            printf("Failed to open map. Path is valid, but map isn't.\n");
+            return 0;
+        }
+        uint32_t checksum = calculateMapChecksum(map);
+        uint32_t stored = ((HaloMapHeader *)map.buffer)->crc32;
+        printf("Checksum: 0x%08X\n",checksum);
+        printf("Header:   0x%08X%s\n",stored,stored == checksum ? "" : " (out of date)");
+        mapClose(&map);
+        return 0;
+    }
+    else if(strcmp(argv[1],"--diff") == 0) {
+        if(argc != 4) {
+            printf("Syntax: deathstar --diff <old map> <new map>\n");
+            printf("Use deathstar --help --diff for more information.\n");
+            return 0;
+        }
+        MapData maps[2];
+        for(int i=0;i<2;i++) {
+            maps[i] = strcmp(argv[i + 2],"-") == 0 ? openMapArgument(argv[i + 2]) : openMapMappedAtPath(argv[i + 2]);
+            if(maps[i].error == MAP_INVALID_PATH) {
+                printf("Failed to open map at %s. Invalid path?\n",argv[i + 2]);
+                return 0;
+            }
+            else if(maps[i].error != MAP_OK) {
+                printf("Failed to open map at %s. Path is valid, but map isn't.\n",argv[i + 2]);
+                return 0;
+            }
+        }
+        MapDiff diff = diffMaps(maps[0], maps[1], threads ? threads : processorCount());
+        const char *changeNames[] = { "added", "removed", "reclassified", "renamed", "changed" };
+        uint32_t totals[5] = { 0 };
+        for(uint32_t i=0;i<diff.count;i++) {
+            TagDiff *tag = &diff.tags[i];
+            printf("{\"old_tag\":");
+            if(tag->oldTag == UINT32_MAX) printf("null"); else printf("%u",tag->oldTag);
+            printf(",\"new_tag\":");
+            if(tag->newTag == UINT32_MAX) printf("null"); else printf("%u",tag->newTag);
+            printf(",\"changes\":[");
+            bool first = true;
+            for(int change=0;change<5;change++) {
+                if(!(tag->changes & (1 << change))) continue;
+                printf("%s\"%s\"",first ? "" : ",",changeNames[change]);
+                totals[change]++;
+                first = false;
+            }
+            printf("],\"old_class\":");
+            if(tag->changes & TAG_DIFF_ADDED) printf("null"); else printJSONClass(tag->oldClass);
+            printf(",\"new_class\":");
+            if(tag->changes & TAG_DIFF_REMOVED) printf("null"); else printJSONClass(tag->newClass);
+            printf(",\"old_name\":");
+            printJSONString(tag->oldName);
+            printf(",\"new_name\":");
+            printJSONString(tag->newName);
+            printf("}\n");
+        }
+        printf("{\"summary\":{\"added\":%u,\"removed\":%u,\"reclassified\":%u,\"renamed\":%u,\"changed\":%u}}\n",totals[0],totals[1],totals[2],totals[3],totals[4]);
+        freeMapDiff(&diff);
+        mapClose(&maps[0]);
+        mapClose(&maps[1]);
+        return 0;
+    }
+    else if(strcmp(argv[1],"--scan") == 0) {
+        if(argc < 3) {
+            printf("Syntax: deathstar --scan <map> [maps...]\n");
+            printf("Use deathstar --help --scan for more information.\n");
+            return 0;
+        }
+        uint32_t count = argc - 2;
+        MapScan *scans = malloc(sizeof(MapScan) * count);
+        scanMaps(argv + 2, count, scans, threads ? threads : processorCount());
+        uint32_t protectedMaps = 0;
+        for(uint32_t i=0;i<count;i++) {
+            MapScan *scan = &scans[i];
+            printf("{\"map\":");
+            printJSONString(argv[i + 2]);
+            if(scan->error == MAP_INVALID_PATH) {
+                printf(",\"error\":\"invalid path\"}\n");
+                continue;
+            }
+            else if(scan->error != MAP_OK) {
+                printf(",\"error\":\"invalid map\"}\n");
+                continue;
+            }
+            printf(",\"version\":%u,\"edition\":\"%s\",\"tags\":%u,\"classes\":{",scan->version,scan->version == HALO_VERSION_CE ? "ce" : scan->version == HALO_VERSION_PC ? "pc" : "unknown",scan->tagCount);
+            for(uint32_t c=0;c<scan->classCount;c++) {
+                if(c > 0) putchar(',');
+                printJSONClass(scan->classes[c].tagClass);
+                printf(":%u",scan->classes[c].count);
+            }
+            printf("},\"unknown_classes\":%u,\"mismatched_classes\":%u,\"invalid_name_offsets\":%u,\"names_outside_meta\":%u,\"protected\":%s}\n",scan->unknownClasses,scan->mismatchedClasses,scan->invalidNameOffsets,scan->namesOutsideMeta,scan->protected ? "true" : "false");
+            if(scan->protected) protectedMaps++;
+            freeMapScan(scan);
+        }
+        printf("{\"summary\":{\"maps\":%u,\"protected\":%u}}\n",count,protectedMaps);
+        free(scans);
+        return 0;
+    }
+    else if(strcmp(argv[1],"--merge") == 0) {
+        if(argc != 3 && !(argc == 4 && strcmp(argv[3],"--keep-clones") == 0)) {
+            printf("Syntax: deathstar --merge <map> [--keep-clones]\n");
+            printf("Use deathstar --help --merge for more information.\n");
+            return 0;
+        }
+        MapData map = openMapArgument(argv[2]);
+        if(map.error == MAP_INVALID_PATH) {
+            printf("Failed to open map at %s. Invalid path?\n",argv[2]);
+            return 0;
+        }
+        else if(map.error != MAP_OK) {
+            printf("Failed to open map. Path is valid, but map isn't.\n");
+            return 0;
+        }
+        MergeReport report;
+        MapData merged = mergeDuplicateTags(map, &report);
+        mapClose(&map);
+        if(report.mergedTags == 0) {
+            printf("No identical tags were found. No changes were made.\n");
+            mapClose(&merged);
+            return 0;
+        }
+        printf("Merged %u tags.\n",report.mergedTags);
+        if(argc == 3) {
+            StripReport stripReport;
+            MapData stripped = stripDeadTags(merged, &stripReport);
+            mapClose(&merged);
+            merged = stripped;
+            if(stripReport.result == STRIP_OK)
+                printf("Removed %u tags (%u bytes).\n",stripReport.removedTags,stripReport.removedBytes);
+            else
+                printf("The clones could not be stripped, so they were kept.\n");
+        }
+        uint32_t checksum = updateMapChecksum(merged);
+        if(saveMapArgument(mapDestination(argv[2]), merged) == 0)
+            printf("Completed. Map has been saved! Checksum: 0x%08X\n",checksum);
+        else
+            printf("Failed to save map. It might be read-only.\n");
+        mapClose(&merged);
+        return 0;
+    }
+    else if(strcmp(argv[1],"--strip") == 0) {
+        if(argc != 3) {
+            printf("Syntax: deathstar --strip <map>\n");
+            printf("Use deathstar --help --strip for more information.\n");
+            return 0;
+        }
+        MapData map = openMapArgument(argv[2]);
+        if(map.error == MAP_INVALID_PATH) {
+            printf("Failed to open map at %s. Invalid path?\n",argv[2]);
+            return 0;
+        }
+        else if(map.error != MAP_OK) {
+            printf("Failed to open map. Path is valid, but map isn't.\n");
+            return 0;
+        }
+        StripReport report;
+        MapData stripped = stripDeadTags(map, &report);
+        mapClose(&map);
+        if(report.result == STRIP_NOTHING_TO_REMOVE) {
+            printf("Every tag is in use. No changes were made.\n");
+        }
+        else if(report.result == STRIP_UNSUPPORTED_LAYOUT) {
+            printf("The map has data after its tags, so it can't be stripped.\n");
+        }
+        else if(report.result == STRIP_DANGLING_POINTER) {
+            printf("A tag that is in use points into an unused tag, so the map can't be stripped.\n");
+        }
+        else {
+            uint32_t checksum = updateMapChecksum(stripped);
+            if(saveMapArgument(mapDestination(argv[2]), stripped) == 0)
+                printf("Removed %u tags (%u bytes). Map has been saved! Checksum: 0x%08X\n",report.removedTags,report.removedBytes,checksum);
+            else
+                printf("Failed to save map. It might be read-only.\n");
+        }
+        mapClose(&stripped);
+        return 0;
+    }
+    else if(strcmp(argv[1],"--extract") == 0) {
+        if(argc != 4) {
+            printf("Syntax: deathstar --extract <map> <directory>\n");
+            printf("Use deathstar --help --extract for more information.\n");
+            return 0;
+        }
+        MapData map = openMapArgument(argv[2]);
+        if(map.error == MAP_INVALID_PATH) {
+            printf("Failed to open map at %s. Invalid path?\n",argv[2]);
+            return 0;
+        }
+        else if(map.error != MAP_OK) {
+            printf("Failed to open map. Path is valid, but map isn't.\n");
+            return 0;
+        }
+        uint32_t tagCount = ((HaloMapIndex *)(map.buffer + ((HaloMapHeader *)map.buffer)->indexOffset))->tagCount;
+        uint32_t extracted = extractTags(map, argv[3], threads ? threads : processorCount());
+        printf("Extracted %u of %u tags to %s.\n",extracted,tagCount,argv[3]);
+        mapClose(&map);
+        return 0;
+    }
+    else if(strcmp(argv[1],"--watch") == 0) {
+        if(argc != 4) {
+            printf("Syntax: deathstar --watch <incoming> <output>\n");
+            printf("Use deathstar --help --watch for more information.\n");
+            return 0;
+        }
+        WatchOptions options;
+        options.workers = threads ? threads : processorCount();
+        options.queueSize = 0;
+        options.cache = cache.directory ? &cache : NULL;
+        options.operation = deprotectOperation;
+        options.zteam = zteamOptions();
+        options.nameLayout = compactNames ? NAME_LAYOUT_COMPACT : NAME_LAYOUT_APPEND;
+        return watchDirectory(argv[2], argv[3], options);
     }
     else if(strcmp(argv[1],"--argument") == 0) {
         printf("Syynantax:as: -arrrar-gummeargmetnetn\n"); //Funny!
@@ -163,27 +951,41 @@ int main(int argc, const char * argv[])
             return 0;
         }
         else {
-            MapData map = openMapAtPath(argv[2]);
+            MapData map = openMapArgument(argv[2]);
             if(map.error == MAP_INVALID_PATH) {
                 printf("Failed to open map at %s. Invalid path?\n",argv[2]);
                 return 0;
             }
-            else if(map.error == MAP_INVALID_INDEX_POINTER) {
+            else if(map.error != MAP_OK) {
                 printf("Failed to open map. Path is valid, but map isn't.\n");
                 return 0;
             }
             
+            uint64_t inputHash = cache.directory ? hashMap(map) : 0;
+            if(saveCachedResult(mapDestination(argv[2]), inputHash, nameOperation)) {
+                mapClose(&map);
+                return 0;
+            }
+            
             MapData *maps = malloc(sizeof(MapData) * (argc - 3));
             
             for(int i=3; i<argc; i++) {
-                maps[i] = openMapAtPath(argv[i]);
+                maps[i - 3] = openMapAtPath(argv[i]);
             }
             
-            MapData final_map = name_deprotect(map);
-            if(saveMap(argv[2], final_map) == 0)
-                printf("Completed. Map has been saved!\n");
+            MapData final_map = runPasses(map, "name,checksum");
+            uint32_t checksum = ((HaloMapHeader *)final_map.buffer)->crc32;
+            if(cache.directory) mapCacheStore(cache, inputHash, nameOperation, final_map);
+            if(saveMapArgument(mapDestination(argv[2]), final_map) == 0)
+                printf("Completed. Map has been saved! Checksum: 0x%08X\n",checksum);
             else
                 printf("Failed to save map. It might be read-only.\n");
+            
+            for(int i=3; i<argc; i++) {
+                mapClose(&maps[i - 3]);
+            }
+            free(maps);
+            mapClose(&final_map);
         }
         
     }
@@ -194,32 +996,73 @@ int main(int argc, const char * argv[])
             return 0;
         }
         else {
-            MapData map = openMapAtPath(argv[2]);
+            MapData map = openMapArgument(argv[2]);
             if(map.error == MAP_INVALID_PATH) {
                 printf("Failed to open map at %s. Invalid path?\n",argv[2]);
                 return 0;
             }
-            else if(map.error == MAP_INVALID_INDEX_POINTER) {
+            else if(map.error != MAP_OK) {
                 printf("Failed to open map. Path is valid, but map isn't.\n");
                 return 0;
             }
-            MapData zteam_map = zteam_deprotect(map);
-            
-            free(map.buffer);
+            uint64_t inputHash = cache.directory ? hashMap(map) : 0;
+            if(saveCachedResult(mapDestination(argv[2]), inputHash, deprotectOperation)) {
+                mapClose(&map);
+                return 0;
+            }
             
             MapData *maps = malloc(sizeof(MapData) * (argc - 3));
             
             for(int i=3; i<argc; i++) {
-                maps[i] = openMapAtPath(argv[i]);
+                maps[i - 3] = openMapAtPath(argv[i]);
             }
             
-            MapData final_map = name_deprotect(zteam_map);
+            MapData final_map = runPasses(map, "zteam,name,checksum");
+            uint32_t checksum = ((HaloMapHeader *)final_map.buffer)->crc32;
+            if(cache.directory) mapCacheStore(cache, inputHash, deprotectOperation, final_map);
             
-            if(saveMap(argv[2], final_map) == 0)
-                printf("Completed. Map has been saved!\n");
+            if(saveMapArgument(mapDestination(argv[2]), final_map) == 0)
+                printf("Completed. Map has been saved! Checksum: 0x%08X\n",checksum);
             else
                 printf("Failed to save map. It might be read-only.\n");
+            
+            for(int i=3; i<argc; i++) {
+                mapClose(&maps[i - 3]);
+            }
+            free(maps);
+            mapClose(&final_map);
+        }
+        return 0;
+    }
+    else if(strcmp(argv[1],"--batch") == 0) {
+        if(argc < 3) {
+            printf("Syntax: deathstar --batch <map> [maps...]\n");
+            printf("Use deathstar --help --batch for more information.\n");
+            return 0;
+        }
+        int completed = 0;
+        if(isolate) {
+            WorkerPoolOptions options;
+            options.workers = threads ? threads : processorCount();
+            options.timeoutSeconds = timeoutSeconds;
+            options.processMap = batchMap;
+            options.reportResult = batchReport;
+            options.context = &completed;
+            threads = 1; //the pool already keeps every processor busy
+            runWorkerPool(argv + 2, argc - 2, options);
+            printf("Completed %d of %d maps.\n",completed,argc - 2);
+            return 0;
+        }
+        MapArena arena;
+        mapArenaInit(&arena, 0);
+        setDeathstarArena(&arena);
+        for(int i=2;i<argc;i++) {
+            batchReport(argv[i], batchMap(argv[i], NULL), &completed);
+            mapArenaReset(&arena);
         }
+        printf("Completed %d of %d maps. Peak scratch memory: %lu KiB\n",completed,argc - 2,(unsigned long)(arena.peak / 1024));
+        setDeathstarArena(NULL);
+        mapArenaFree(&arena);
         return 0;
     }
     else if(strcmp(argv[1],"--zteam") == 0) {
@@ -229,20 +1072,29 @@ int main(int argc, const char * argv[])
             return 0;
         }
         else {
-            MapData map = openMapAtPath(argv[2]);
+            MapData map = openMapArgument(argv[2]);
             if(map.error == MAP_INVALID_PATH) {
                 printf("Failed to open map at %s. Invalid path?\n",argv[2]);
                 return 0;
             }
-            else if(map.error == MAP_INVALID_INDEX_POINTER) {
+            else if(map.error != MAP_OK) {
                 printf("Failed to open map. Path is valid, but map isn't.\n");
                 return 0;
             }
-            MapData final_map = zteam_deprotect(map);
-            if(saveMap(argv[2], final_map) == 0)
-                printf("Completed. Map has been saved!\n");
+            uint64_t inputHash = cache.directory ? hashMap(map) : 0;
+            if(saveCachedResult(mapDestination(argv[2]), inputHash, zteamOperation)) {
+                mapClose(&map);
+                return 0;
+            }
+            
+            MapData final_map = runPasses(map, "zteam,checksum");
+            uint32_t checksum = ((HaloMapHeader *)final_map.buffer)->crc32;
+            if(cache.directory) mapCacheStore(cache, inputHash, zteamOperation, final_map);
+            if(saveMapArgument(mapDestination(argv[2]), final_map) == 0)
+                printf("Completed. Map has been saved! Checksum: 0x%08X\n",checksum);
             else
                 printf("Failed to save map. It might be read-only.\n");
+            mapClose(&final_map);
         }
         return 0;
     }
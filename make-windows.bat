@@ -1 +1 @@
-gcc -std=c99 ZZTTagClasses.c ZZTDeathstar.c main.c -o deathstar.exe
\ No newline at end of file
+gcc -std=c99 -pthread ZZTTagClasses.c ZZTEngine.c ZZTArena.c ZZTMapIndex.c ZZTHash.c ZZTMapCache.c ZZTChecksum.c ZZTStringTable.c ZZTParallel.c ZZTTrace.c ZZTExtract.c ZZTStrip.c ZZTDiff.c ZZTWatch.c ZZTScan.c ZZTJournal.c ZZTCoverage.c ZZTPipeline.c ZZTWorkerPool.c ZZTDeathstar.c main.c -o deathstar.exe
\ No newline at end of file
@@ -0,0 +1,833 @@
+// ZZTTest.c
+
+/*
+ 
+ Copyright (c) 2014, Paul Whitcomb
+ All rights reserved.
+ 
+ Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met:
+ 
+ * Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+ * Neither the name of Paul Whitcomb nor the names of its contributors may be used to endorse or promote products derived from this software without specific prior written permission.
+ 
+ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ 
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stddef.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <signal.h>
+#include "ZZTDeathstar.h"
+#include "ZZTTagData.h"
+#include "ZZTJournal.h"
+#include "ZZTPipeline.h"
+#include "ZZTDiff.h"
+#include "ZZTMapCache.h"
+#include "ZZTExtract.h"
+#include "ZZTStringTable.h"
+#include "ZZTMapIndex.h"
+#include "ZZTChecksum.h"
+#include "ZZTStrip.h"
+#include "ZZTScan.h"
+#include "ZZTWorkerPool.h"
+#include "ZZTCoverage.h"
+
+//a small CE map with a scenario, a weapon that needs its classes restored, and a tag collection
+#define TEST_META_MEMORY_OFFSET 0x40440000
+#define TEST_INDEX_OFFSET 0x800
+#define TEST_BLOB_SIZE 0x4000
+
+enum { TEST_SCNR, TEST_MATG, TEST_WEAP, TEST_MOD2, TEST_BITM, TEST_BITM2, TEST_JUNK, TEST_TAGC, TEST_PROJ, TEST_TAG_COUNT };
+
+static uint32_t failures = 0;
+
+#define CHECK(condition) do { if(!(condition)) { printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); failures++; } } while(0)
+
+typedef struct {
+    char data[TEST_BLOB_SIZE];
+    uint32_t length;
+} TestBlob;
+
+static uint32_t testAllocate(TestBlob *blob, uint32_t size) { //offset of size zeroed bytes, 4-byte aligned
+    blob->length = (blob->length + 3) & ~3U;
+    uint32_t offset = blob->length;
+    memset(blob->data + offset, 0, size);
+    blob->length += size;
+    return offset;
+}
+
+static uint32_t testPointer(uint32_t offset) { //the blob follows the index and the tag array
+    return TEST_META_MEMORY_OFFSET + sizeof(HaloMapIndex) + sizeof(MapTag) * TEST_TAG_COUNT + offset;
+}
+
+static TagID testTagID(uint32_t tag) {
+    TagID identity;
+    identity.tagTableIndex = (uint16_t)tag;
+    identity.tableIndex = (uint16_t)(0xE000 + tag);
+    return identity;
+}
+
+static void testDependency(TestBlob *blob, uint32_t offset, const char *class, uint32_t tag) {
+    Dependency *dependency = (Dependency *)(blob->data + offset);
+    memcpy(dependency->mainClass, class, 4);
+    dependency->tagId = testTagID(tag);
+}
+
+static void testReflexive(TestBlob *blob, uint32_t offset, uint32_t count, uint32_t target) {
+    TagReflexive *reflexive = (TagReflexive *)(blob->data + offset);
+    reflexive->count = count;
+    reflexive->offset = testPointer(target);
+}
+
+static const char *testNames[TEST_TAG_COUNT] = { "levels\\test\\test", "globals\\globals", "weapons\\gun\\gun", "weapons\\gun\\gun", "weapons\\gun\\tex", "weapons\\gun\\tex2", "junk\\junk", "ui\\collection", "weapons\\gun\\bullet" };
+
+static MapData buildTestMapWithNames(const char **names) {
+    static const char *scrambled[TEST_TAG_COUNT] = { SCNR, MATG, BITM, SND, WEAP, MOD2, BITM, TAGC, BITM };
+    static TestBlob blob;
+    uint32_t offsets[TEST_TAG_COUNT];
+    blob.length = 0;
+    
+    offsets[TEST_BITM] = testAllocate(&blob, 0x60);
+    offsets[TEST_BITM2] = testAllocate(&blob, 0x60);
+    offsets[TEST_JUNK] = testAllocate(&blob, 0x60);
+    offsets[TEST_MOD2] = testAllocate(&blob, sizeof(Mod2Dependencies) + 0xC);
+    offsets[TEST_PROJ] = testAllocate(&blob, 0x300);
+    *(uint16_t *)(blob.data + offsets[TEST_PROJ]) = 5;
+    
+    uint32_t trigger = testAllocate(&blob, sizeof(WeapTriggerDependencies));
+    testDependency(&blob, trigger + offsetof(WeapTriggerDependencies, projectile), PROJ, TEST_PROJ);
+    uint32_t resource = testAllocate(&blob, sizeof(ObjeResources));
+    ((ObjeResources *)(blob.data + resource))->name = testTagID(TEST_BITM);
+    offsets[TEST_WEAP] = testAllocate(&blob, sizeof(WeapDependencies));
+    *(uint16_t *)(blob.data + offsets[TEST_WEAP]) = 2;
+    testDependency(&blob, offsets[TEST_WEAP] + offsetof(ObjeDependencies, model), MOD2, TEST_MOD2);
+    testReflexive(&blob, offsets[TEST_WEAP] + offsetof(ObjeDependencies, resources), 1, resource);
+    testReflexive(&blob, offsets[TEST_WEAP] + offsetof(WeapDependencies, triggers), 1, trigger);
+    
+    uint32_t palette = testAllocate(&blob, sizeof(ScnrPaletteDependency));
+    testDependency(&blob, palette, WEAP, TEST_WEAP);
+    offsets[TEST_SCNR] = testAllocate(&blob, 0x5B0);
+    testReflexive(&blob, offsets[TEST_SCNR] + offsetof(ScnrDependencies, weaponPalette), 1, palette);
+    offsets[TEST_MATG] = testAllocate(&blob, 0x1A0);
+    
+    uint32_t collected = testAllocate(&blob, sizeof(Dependency));
+    testDependency(&blob, collected, BITM, TEST_BITM2);
+    offsets[TEST_TAGC] = testAllocate(&blob, sizeof(TagReflexive));
+    testReflexive(&blob, offsets[TEST_TAGC], 1, collected);
+    
+    uint32_t nameOffsets[TEST_TAG_COUNT];
+    for(uint32_t i=0;i<TEST_TAG_COUNT;i++) {
+        nameOffsets[i] = testAllocate(&blob, (uint32_t)strlen(names[i]) + 1);
+        strcpy(blob.data + nameOffsets[i], names[i]);
+    }
+    testAllocate(&blob, 0);
+    
+    uint32_t metaSize = sizeof(HaloMapIndex) + sizeof(MapTag) * TEST_TAG_COUNT + blob.length;
+    MapData map = mapAllocate(TEST_INDEX_OFFSET + metaSize);
+    memset(map.buffer, 0, map.length);
+    HaloMapHeader *header = (HaloMapHeader *)map.buffer;
+    memcpy(&header->integrityHead, "daeh", 4);
+    memcpy(&header->integrityFoot, "toof", 4);
+    header->version = 609;
+    header->length = map.length;
+    header->indexOffset = TEST_INDEX_OFFSET;
+    header->metaSize = metaSize;
+    strcpy(header->name, "test");
+    
+    HaloMapIndex *index = (HaloMapIndex *)(map.buffer + TEST_INDEX_OFFSET);
+    index->tagIndexOffset = TEST_META_MEMORY_OFFSET + sizeof(HaloMapIndex);
+    index->scenarioTag = testTagID(TEST_SCNR);
+    index->mapId = 0x1234;
+    index->tagCount = TEST_TAG_COUNT;
+    memcpy(&index->tags, "sgat", 4);
+    
+    MapTag *tags = (MapTag *)(map.buffer + TEST_INDEX_OFFSET + sizeof(HaloMapIndex));
+    for(uint32_t i=0;i<TEST_TAG_COUNT;i++) {
+        memcpy(&tags[i].classA, scrambled[i], 4);
+        tags[i].classB = 0xFFFFFFFF;
+        tags[i].classC = 0xFFFFFFFF;
+        tags[i].identity = testTagID(i);
+        tags[i].nameOffset = testPointer(nameOffsets[i]);
+        tags[i].dataOffset = testPointer(offsets[i]);
+    }
+    memcpy(tags + TEST_TAG_COUNT, blob.data, blob.length);
+    return map;
+}
+
+static MapData buildTestMap(void) {
+    return buildTestMapWithNames(testNames);
+}
+
+static MapTag *testTags(MapData map) {
+    return (MapTag *)(map.buffer + TEST_INDEX_OFFSET + sizeof(HaloMapIndex));
+}
+
+static void *testData(MapData map, uint32_t pointer) {
+    return map.buffer + pointer - (TEST_META_MEMORY_OFFSET - TEST_INDEX_OFFSET);
+}
+
+static const char *testTagName(MapData map, uint32_t tag) {
+    return testData(map, testTags(map)[tag].nameOffset);
+}
+
+static uint32_t testClass(const char *tagClass) {
+    uint32_t value;
+    memcpy(&value, tagClass, sizeof(value));
+    return value;
+}
+
+static void testTagIndex(void) {
+    MapData map = buildTestMap();
+    MapTagIndex index = buildMapTagIndex(map);
+    CHECK(index.count == TEST_TAG_COUNT);
+    CHECK(index.classA[TEST_WEAP] == testClass(BITM) && index.classA[TEST_MOD2] == testClass(SND));
+    for(uint32_t i=0;i<TEST_TAG_COUNT;i++) CHECK(index.flags[i] & TAG_INDEX_NAME_IN_MAP);
+    CHECK(index.flags[TEST_MATG] & TAG_INDEX_GLOBALS);
+    CHECK(index.flags[TEST_TAGC] & TAG_INDEX_SHARED_NAME);
+    CHECK(!(index.flags[TEST_WEAP] & (TAG_INDEX_SHARED_NAME | TAG_INDEX_GLOBALS | TAG_INDEX_EXTERNAL)));
+    CHECK(findFirstTagWithFlags(&index, TAG_INDEX_GLOBALS) == TEST_MATG);
+    CHECK(findFirstTagWithFlags(&index, TAG_INDEX_EXTERNAL) == TEST_TAG_COUNT);
+    uint32_t found[TEST_TAG_COUNT];
+    CHECK(findTagsOfClass(&index, testClass(BITM), found) == 3 && found[0] == TEST_WEAP && found[1] == TEST_JUNK && found[2] == TEST_PROJ);
+    freeMapTagIndex(&index);
+    mapClose(&map);
+    
+    //enough tags for the blocks of 16, with matches on both sides of a block boundary and in the tail
+    uint32_t classes[40];
+    for(uint32_t i=0;i<40;i++) classes[i] = i % 7 == 0 || i == 15 || i == 16 ? testClass(WEAP) : testClass(BITM);
+    MapTagIndex synthetic;
+    memset(&synthetic, 0, sizeof(synthetic));
+    synthetic.count = 40;
+    synthetic.classA = classes;
+    uint32_t results[40];
+    uint32_t count = findTagsOfClass(&synthetic, testClass(WEAP), results);
+    uint32_t expected = 0;
+    for(uint32_t i=0;i<40;i++) {
+        if(classes[i] != testClass(WEAP)) continue;
+        CHECK(expected < count && results[expected] == i);
+        expected++;
+    }
+    CHECK(count == expected);
+}
+
+static void testResolver(void) {
+    MapData map = buildTestMap();
+    TagClassResolver *resolver = createTagClassResolver(map);
+    CHECK(zteam_resolveTagClass(resolver, TEST_SCNR) == testClass(SCNR));
+    CHECK(zteam_resolveTagClass(resolver, TEST_MATG) == testClass(MATG));
+    CHECK(zteam_resolveTagClass(resolver, TEST_WEAP) == testClass(WEAP)); //from the scenario's palette, refined by the object type
+    CHECK(zteam_resolveTagClass(resolver, TEST_MOD2) == testClass(MOD2));
+    CHECK(zteam_resolveTagClass(resolver, TEST_BITM2) == testClass(BITM));
+    CHECK(zteam_resolveTagClass(resolver, TEST_PROJ) == testClass(PROJ));
+    CHECK(zteam_resolveTagClass(resolver, TEST_JUNK) == testClass(BITM)); //nothing names it, so it keeps its class
+    CHECK(zteam_resolveTagClass(resolver, TEST_TAG_COUNT) == 0);
+    CHECK(!zteam_tagClassIsAmbiguous(resolver, TEST_WEAP));
+    freeTagClassResolver(resolver);
+    
+    //the collection now also calls the weapon a model, so the vote is split
+    TagReflexive *collection = testData(map, testTags(map)[TEST_TAGC].dataOffset);
+    Dependency *collected = testData(map, collection->offset);
+    memcpy(collected->mainClass, MOD2, 4);
+    collected->tagId = testTagID(TEST_WEAP);
+    resolver = createTagClassResolver(map);
+    uint32_t weaponClass = zteam_resolveTagClass(resolver, TEST_WEAP);
+    CHECK(weaponClass == testClass(WEAP) || weaponClass == testClass(MOD2));
+    CHECK(zteam_tagClassIsAmbiguous(resolver, TEST_WEAP));
+    CHECK(!zteam_tagClassIsAmbiguous(resolver, TEST_MOD2));
+    freeTagClassResolver(resolver);
+    mapClose(&map);
+}
+
+static uint32_t testCRC32(uint32_t crc, const unsigned char *data, size_t length) { //a bit at a time, as in the zlib documentation
+    crc = ~crc;
+    for(size_t i=0;i<length;i++) {
+        crc ^= data[i];
+        for(int bit=0;bit<8;bit++) crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+    }
+    return ~crc;
+}
+
+static void testChecksum(void) {
+    CHECK(crc32Update(0, "123456789", 9) == 0xCBF43926);
+    CHECK(crc32Update(crc32Update(0, "1234", 4), "56789", 5) == 0xCBF43926);
+    
+    //every alignment and enough length for the slicing loop, against the bitwise version
+    unsigned char bytes[0x400];
+    for(uint32_t i=0;i<sizeof(bytes);i++) bytes[i] = (unsigned char)(i * 131 + 7);
+    for(uint32_t start=0;start<8;start++) {
+        CHECK(crc32Update(0, bytes + start, sizeof(bytes) - start) == testCRC32(0, bytes + start, sizeof(bytes) - start));
+    }
+    
+    //the BSP, the model data, then the metadata; the unused junk tag's data holds the scenario's BSP block
+    MapData map = buildTestMap();
+    HaloMapHeader *header = (HaloMapHeader *)map.buffer;
+    HaloMapIndex *index = (HaloMapIndex *)(map.buffer + TEST_INDEX_OFFSET);
+    MapTag *tags = testTags(map);
+    ScnrDependencies *scenario = testData(map, tags[TEST_SCNR].dataOffset);
+    scenario->BSPs.count = 1;
+    scenario->BSPs.offset = tags[TEST_JUNK].dataOffset;
+    ScnrBSPs *bsp = testData(map, tags[TEST_JUNK].dataOffset);
+    bsp->fileOffset = 0x300;
+    bsp->tagSize = 0x80;
+    memcpy(map.buffer + 0x300, bytes + 0x100, 0x80);
+    index->vertexOffset = 0x200;
+    index->modelSize = 0x100;
+    memcpy(map.buffer + 0x200, bytes, 0x100);
+    uint32_t expected = testCRC32(0, (unsigned char *)map.buffer + 0x300, 0x80);
+    expected = testCRC32(expected, (unsigned char *)map.buffer + 0x200, 0x100);
+    expected = testCRC32(expected, (unsigned char *)map.buffer + TEST_INDEX_OFFSET, header->metaSize);
+    CHECK(calculateMapChecksum(map) == expected);
+    CHECK(updateMapChecksum(map) == expected && header->crc32 == expected);
+    CHECK(calculateMapChecksum(map) == expected); //the stored checksum isn't part of it
+    mapClose(&map);
+}
+
+static void testParsePasses(void) {
+    const MapPass *passes[MAX_MAP_PASSES];
+    uint32_t count;
+    CHECK(parseMapPasses("zteam,name,checksum,save", passes, &count) == NULL);
+    CHECK(count == 4 && passes[0] == findMapPass("zteam") && passes[3] == findMapPass("save"));
+    CHECK(parseMapPasses("", passes, &count) == NULL && count == 0);
+    CHECK(parseMapPasses("zteam,bogus", passes, &count) != NULL);
+    
+    char list[0x400] = "";
+    for(uint32_t i=0;i<MAX_MAP_PASSES;i++) strcat(list, i ? ",checksum" : "checksum");
+    CHECK(parseMapPasses(list, passes, &count) == NULL && count == MAX_MAP_PASSES);
+    strcat(list, ",checksum");
+    CHECK(parseMapPasses(list, passes, &count) != NULL && count == MAX_MAP_PASSES); //stops instead of writing past the array
+    
+    //a name cut short to fit the buffer must not match a real pass
+    CHECK(parseMapPasses("checksumxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx", passes, &count) != NULL);
+    CHECK(parseMapPasses("zteam,name,,", passes, &count) != NULL);
+}
+
+static void testOwnership(void) {
+    MapData original = buildTestMap();
+    CHECK(original.error == MAP_OK && original.ownership == MAP_OWNED);
+    
+    char *copy = malloc(original.length);
+    memcpy(copy, original.buffer, original.length);
+    MapData borrowed = openMapFromBufferWithLength(copy, original.length);
+    CHECK(borrowed.error == MAP_OK && borrowed.ownership == MAP_BORROWED);
+    CHECK(openMapFromBufferWithLength(copy, TEST_INDEX_OFFSET + 4).error != MAP_OK);
+    
+    //an in-place pass on a borrowed map works on a copy of its own
+    MapPipeline pipeline;
+    mapPipelineInit(&pipeline, borrowed);
+    const MapPass *zteam = findMapPass("zteam");
+    CHECK(runMapPipeline(&pipeline, &zteam, 1) == NULL);
+    CHECK(pipeline.map.buffer != copy && pipeline.map.ownership == MAP_OWNED);
+    CHECK(memcmp(copy, original.buffer, original.length) == 0);
+    CHECK(memcmp(&testTags(pipeline.map)[TEST_WEAP].classA, WEAP, 4) == 0);
+    mapPipelineClose(&pipeline);
+    CHECK(pipeline.map.buffer == NULL);
+    mapClose(&borrowed);
+    CHECK(borrowed.buffer == NULL && memcmp(copy, original.buffer, original.length) == 0); //still the caller's
+    free(copy);
+    
+    char path[] = "/tmp/deathstar-test-XXXXXX";
+    int file = mkstemp(path);
+    CHECK(file >= 0);
+    CHECK(saveMapToDescriptor(file, original) == 0);
+    close(file);
+    MapData loaded = openMapAtPath(path);
+    CHECK(loaded.error == MAP_OK && loaded.ownership == MAP_OWNED && loaded.length == original.length);
+    CHECK(memcmp(loaded.buffer, original.buffer, original.length) == 0);
+    mapClose(&loaded);
+    CHECK(loaded.buffer == NULL && loaded.length == 0);
+    
+    FILE *stream = fopen(path, "rb");
+    MapData streamed = openMapFromStream(stream);
+    fclose(stream);
+    CHECK(streamed.error == MAP_OK && streamed.ownership == MAP_OWNED && memcmp(streamed.buffer, original.buffer, original.length) == 0);
+    mapClose(&streamed);
+    
+    CHECK(saveMapReplacing(path, original) == 0);
+    loaded = openMapAtPath(path);
+    CHECK(loaded.error == MAP_OK && memcmp(loaded.buffer, original.buffer, original.length) == 0);
+    mapClose(&loaded);
+    remove(path);
+    CHECK(openMapAtPath(path).error == MAP_INVALID_PATH);
+    mapClose(&original);
+}
+
+static void testJournal(void) {
+    MapData original = buildTestMap();
+    MapData map = buildTestMap();
+    ZTeamOptions options;
+    memset(&options, 0, sizeof(options));
+    
+    MapJournal changes = zteam_deprotectJournal(map, options);
+    CHECK(!changes.incomplete && changes.count > 0);
+    CHECK(memcmp(map.buffer, original.buffer, original.length) == 0); //recording leaves the map alone
+    
+    MapData deprotected = zteam_deprotectWithOptions(original, options);
+    mapJournalApply(map, &changes);
+    CHECK(memcmp(map.buffer, deprotected.buffer, deprotected.length) == 0);
+    mapJournalRevert(map, &changes);
+    CHECK(memcmp(map.buffer, original.buffer, original.length) == 0);
+    
+    mapJournalCompact(&changes);
+    for(uint32_t i=1;i<changes.count;i++) CHECK(changes.entries[i - 1].tag < changes.entries[i].tag);
+    mapJournalApply(map, &changes);
+    CHECK(memcmp(map.buffer, deprotected.buffer, deprotected.length) == 0);
+    
+    freeMapJournal(&changes);
+    CHECK(changes.entries == NULL && changes.count == 0);
+    mapClose(&deprotected);
+    mapClose(&map);
+    mapClose(&original);
+}
+
+static void testOutOfRangeTag(void) {
+    //a dependency on the index one past the last tag is as good as null
+    MapData map = buildTestMap();
+    MapTag *tags = testTags(map);
+    Dependency *model = (Dependency *)((char *)testData(map, tags[TEST_WEAP].dataOffset) + offsetof(ObjeDependencies, model));
+    model->tagId = testTagID(TEST_TAG_COUNT);
+    ZTeamOptions options;
+    memset(&options, 0, sizeof(options));
+    MapJournal changes = zteam_deprotectJournal(map, options);
+    CHECK(changes.count > 0);
+    for(uint32_t i=0;i<changes.count;i++) CHECK(changes.entries[i].tag < TEST_TAG_COUNT);
+    freeMapJournal(&changes);
+    mapClose(&map);
+}
+
+static void testSweep(void) {
+    //a sound dependency inside the bitmap's data, where no walker looks
+    MapData map = buildTestMap();
+    MapTag *tags = testTags(map);
+    Dependency *hidden = (Dependency *)((char *)testData(map, tags[TEST_BITM2].dataOffset) + 0x10);
+    memcpy(hidden->mainClass, SND, 4);
+    hidden->tagId = testTagID(TEST_JUNK);
+    
+    ZTeamOptions options;
+    memset(&options, 0, sizeof(options));
+    MapData walked = zteam_deprotectWithOptions(map, options);
+    CHECK(memcmp(&testTags(walked)[TEST_JUNK].classA, BITM, 4) == 0);
+    options.sweepDependencies = true;
+    MapData swept = zteam_deprotectWithOptions(map, options);
+    CHECK(memcmp(&testTags(swept)[TEST_JUNK].classA, SND, 4) == 0);
+    
+    //the sweep only adds tags; whatever the walkers found is the same
+    for(uint32_t i=0;i<TEST_TAG_COUNT;i++) {
+        if(i != TEST_JUNK) CHECK(testTags(swept)[i].classA == testTags(walked)[i].classA);
+    }
+    mapClose(&swept);
+    mapClose(&walked);
+    mapClose(&map);
+}
+
+static void testCoverage(void) {
+    MapData map = buildTestMap();
+    MapData original = buildTestMap();
+    ZTeamOptions options;
+    memset(&options, 0, sizeof(options));
+    MapCoverage coverage = zteam_coverage(map, options);
+    CHECK(memcmp(map.buffer, original.buffer, original.length) == 0); //nothing changed
+    CHECK(coverage.tagCount == TEST_TAG_COUNT);
+    static const uint8_t expected[TEST_TAG_COUNT] = {
+        TAG_COVERAGE_GRAPH, TAG_COVERAGE_SKIPPED, TAG_COVERAGE_GRAPH, TAG_COVERAGE_GRAPH, TAG_COVERAGE_GRAPH,
+        TAG_COVERAGE_COLLECTION, TAG_COVERAGE_UNREACHED, TAG_COVERAGE_COLLECTION, TAG_COVERAGE_GRAPH
+    };
+    for(uint32_t i=0;i<TEST_TAG_COUNT;i++) CHECK(coverage.tags[i] == expected[i]);
+    CHECK(coverage.counts[TAG_COVERAGE_GRAPH] == 5 && coverage.counts[TAG_COVERAGE_COLLECTION] == 2);
+    CHECK(coverage.unreachedCount == 1 && coverage.unreached[0] == TEST_JUNK);
+    
+    //classes are counted after deprotection, so the bitmaps are together
+    bool bitmaps = false;
+    for(uint32_t i=0;i<coverage.classCount;i++) {
+        if(coverage.classes[i].tagClass != testClass(BITM)) continue;
+        bitmaps = coverage.classes[i].counts[TAG_COVERAGE_GRAPH] == 1 && coverage.classes[i].counts[TAG_COVERAGE_COLLECTION] == 1 && coverage.classes[i].counts[TAG_COVERAGE_UNREACHED] == 1;
+    }
+    CHECK(bitmaps);
+    freeMapCoverage(&coverage);
+    
+    //what the sweep finds is told apart from the graph
+    Dependency *hidden = (Dependency *)((char *)testData(map, testTags(map)[TEST_BITM2].dataOffset) + 0x10);
+    memcpy(hidden->mainClass, SND, 4);
+    hidden->tagId = testTagID(TEST_JUNK);
+    options.sweepDependencies = true;
+    coverage = zteam_coverage(map, options);
+    CHECK(coverage.tags[TEST_JUNK] == TAG_COVERAGE_SWEEP && coverage.unreachedCount == 0);
+    freeMapCoverage(&coverage);
+    mapClose(&original);
+    mapClose(&map);
+}
+
+static void testDiff(void) {
+    MapData oldMap = buildTestMap();
+    MapData newMap = buildTestMap();
+    MapDiff diff = diffMaps(oldMap, newMap, 2);
+    CHECK(diff.count == 0);
+    freeMapDiff(&diff);
+    
+    //moving the next tag's data along makes this bitmap 4 bytes longer, with the same first 0x60 bytes
+    testTags(newMap)[TEST_BITM2].dataOffset += 4;
+    diff = diffMaps(oldMap, newMap, 2);
+    bool grownChanged = false;
+    for(uint32_t i=0;i<diff.count;i++) {
+        if(diff.tags[i].oldTag == TEST_BITM) grownChanged = (diff.tags[i].changes & TAG_DIFF_CHANGED) != 0;
+    }
+    CHECK(grownChanged);
+    freeMapDiff(&diff);
+    
+    memcpy(&testTags(newMap)[TEST_WEAP].classA, WEAP, 4);
+    diff = diffMaps(oldMap, newMap, 1);
+    bool reclassified = false;
+    for(uint32_t i=0;i<diff.count;i++) {
+        if(diff.tags[i].oldTag == TEST_WEAP) reclassified = (diff.tags[i].changes & TAG_DIFF_RECLASSIFIED) != 0;
+    }
+    CHECK(reclassified);
+    freeMapDiff(&diff);
+    mapClose(&newMap);
+    
+    //swapping two tags in the array moves them, it doesn't change them
+    newMap = buildTestMap();
+    MapTag *tags = testTags(newMap);
+    MapTag swap = tags[TEST_JUNK];
+    tags[TEST_JUNK] = tags[TEST_PROJ];
+    tags[TEST_PROJ] = swap;
+    diff = diffMaps(oldMap, newMap, 2);
+    CHECK(diff.count == 0);
+    freeMapDiff(&diff);
+    
+    //a renamed tag is still found by its tag ID
+    tags[TEST_PROJ] = tags[TEST_JUNK];
+    tags[TEST_JUNK] = swap;
+    tags[TEST_JUNK].nameOffset = tags[TEST_TAGC].nameOffset;
+    diff = diffMaps(oldMap, newMap, 2);
+    CHECK(diff.count == 1 && diff.tags[0].oldTag == TEST_JUNK && diff.tags[0].newTag == TEST_JUNK && diff.tags[0].changes == TAG_DIFF_RENAMED);
+    freeMapDiff(&diff);
+    mapClose(&oldMap);
+    mapClose(&newMap);
+}
+
+static void testCompactNames(void) {
+    //long original names leave room for the generated ones, and the kept names are longer than a generated name can be
+    char longNames[TEST_TAG_COUNT][0x80];
+    const char *names[TEST_TAG_COUNT];
+    for(uint32_t i=0;i<TEST_TAG_COUNT;i++) {
+        snprintf(longNames[i], sizeof(longNames[i]), "%s\\%s", testNames[i], "a_name_longer_than_any_generated_name_so_it_must_be_kept_whole_by_the_compact_layout");
+        names[i] = longNames[i];
+    }
+    CHECK(strlen(longNames[TEST_MATG]) > 0x50);
+    MapData original = buildTestMapWithNames(names);
+    NameDeprotectOptions options;
+    options.layout = NAME_LAYOUT_COMPACT;
+    options.threads = 1;
+    MapData compact = name_deprotectWithOptions(original, options);
+    CHECK(compact.error == MAP_OK && compact.length == original.length); //fit in the old region
+    CHECK(strcmp(testTagName(compact, TEST_MATG), longNames[TEST_MATG]) == 0);
+    CHECK(strcmp(testTagName(compact, TEST_TAGC), longNames[TEST_TAGC]) == 0);
+    CHECK(strncmp(testTagName(compact, TEST_BITM), "deathstar\\test\\", 15) == 0);
+    mapClose(&compact);
+    mapClose(&original);
+}
+
+static void testStringTable(void) {
+    const char *strings[] = { "sound\\sfx\\hit", "sfx\\hit", "hit", "sound\\sfx\\hit", "deathstar\\test\\bitmap\\tag_1", "deathstar\\test\\bitmap\\tag_11" };
+    StringTable table = buildStringTable(strings, 6);
+    CHECK(table.count == 6);
+    CHECK(table.length == strlen(strings[0]) + 1 + strlen(strings[4]) + 1 + strlen(strings[5]) + 1); //only the generated names need room of their own
+    for(uint32_t i=0;i<6;i++) CHECK(strcmp(table.buffer + table.offsets[i], strings[i]) == 0);
+    CHECK(table.offsets[0] == table.offsets[3]);
+    freeStringTable(&table);
+    CHECK(table.buffer == NULL);
+}
+
+static void testNameThreads(void) {
+    MapData original = buildTestMap();
+    NameDeprotectOptions options;
+    options.layout = NAME_LAYOUT_APPEND;
+    options.threads = 1;
+    MapData serial = name_deprotectWithOptions(original, options);
+    options.threads = 4;
+    MapData parallel = name_deprotectWithOptions(original, options);
+    CHECK(serial.length > original.length);
+    CHECK(serial.length == parallel.length && memcmp(serial.buffer, parallel.buffer, serial.length) == 0);
+    mapClose(&parallel);
+    mapClose(&serial);
+    mapClose(&original);
+}
+
+static bool testFileExists(const char *directory, const char *name) {
+    char path[0x200];
+    snprintf(path, sizeof(path), "%s/%s", directory, name);
+    FILE *file = fopen(path, "rb");
+    if(file) fclose(file);
+    return file != NULL;
+}
+
+static void testExtract(void) {
+    MapData map = buildTestMap();
+    MapTag *tags = testTags(map);
+    memcpy(&tags[TEST_MOD2].classA, MOD2, 4);
+    memcpy(&tags[TEST_BITM].classA, BITM, 4);
+    memcpy(&tags[TEST_BITM2].classA, BITM, 4);
+    tags[TEST_BITM2].nameOffset = tags[TEST_BITM].nameOffset; //two bitmaps called weapons\gun\tex
+    
+    char directory[] = "/tmp/deathstar-extract-XXXXXX";
+    CHECK(mkdtemp(directory) != NULL);
+    char path[0x200];
+    CHECK(extractTagPath(map, TEST_MOD2, directory, path, sizeof(path)) > 0);
+    CHECK(strcmp(path + strlen(directory), "/weapons/gun/gun.gbxmodel") == 0);
+    CHECK(extractTags(map, directory, 2) > 0);
+    CHECK(testFileExists(directory, "weapons/gun/gun.gbxmodel"));
+    CHECK(testFileExists(directory, "weapons/gun/tex.bitmap"));
+    snprintf(path, sizeof(path), "weapons/gun/tex_%u.bitmap", TEST_BITM2);
+    CHECK(testFileExists(directory, path));
+    
+    char command[0x200];
+    snprintf(command, sizeof(command), "rm -rf %s", directory);
+    CHECK(system(command) == 0);
+    mapClose(&map);
+}
+
+static void testStrip(void) {
+    MapData original = buildTestMap();
+    StripReport report;
+    MapData stripped = stripDeadTags(original, &report);
+    CHECK(report.result == STRIP_OK && report.removedTags == 1 && report.removedBytes > 0);
+    CHECK(stripped.length < original.length);
+    HaloMapIndex *index = (HaloMapIndex *)(stripped.buffer + TEST_INDEX_OFFSET);
+    CHECK(index->tagCount == TEST_TAG_COUNT - 1);
+    
+    //the junk tag is gone, the ones after it moved down, and references to them followed
+    MapTag *tags = testTags(stripped);
+    CHECK(strcmp(testTagName(stripped, TEST_JUNK), "ui\\collection") == 0);
+    CHECK(strcmp(testTagName(stripped, TEST_JUNK + 1), "weapons\\gun\\bullet") == 0);
+    CHECK(tags[TEST_JUNK + 1].identity.tagTableIndex == TEST_JUNK + 1 && tags[TEST_JUNK + 1].identity.tableIndex == testTagID(TEST_PROJ).tableIndex - 1);
+    WeapDependencies *weapon = testData(stripped, tags[TEST_WEAP].dataOffset);
+    WeapTriggerDependencies *trigger = testData(stripped, weapon->triggers.offset);
+    CHECK(trigger->projectile.tagId.tagTableIndex == TEST_JUNK + 1);
+    CHECK(trigger->projectile.nameOffset != 0 && strcmp(testData(stripped, trigger->projectile.nameOffset), "weapons\\gun\\bullet") == 0);
+    
+    MapData again = stripDeadTags(stripped, &report);
+    CHECK(report.result == STRIP_NOTHING_TO_REMOVE && again.length == stripped.length && memcmp(again.buffer, stripped.buffer, stripped.length) == 0);
+    mapClose(&again);
+    mapClose(&stripped);
+    mapClose(&original);
+}
+
+static void testMerge(void) {
+    //the two bitmaps and the junk tag are all 0x60 zeroed bytes
+    MapData original = buildTestMap();
+    MapTag *tags = testTags(original);
+    memcpy(&tags[TEST_BITM].classA, BITM, 4);
+    memcpy(&tags[TEST_BITM2].classA, BITM, 4);
+    MergeReport report;
+    MapData merged = mergeDuplicateTags(original, &report);
+    CHECK(report.mergedTags == 2 && report.rounds >= 1);
+    CHECK(merged.length == original.length);
+    tags = testTags(merged);
+    TagReflexive *collection = testData(merged, tags[TEST_TAGC].dataOffset);
+    Dependency *collected = testData(merged, collection->offset);
+    CHECK(collected->tagId.tagTableIndex == TEST_BITM && collected->nameOffset == tags[TEST_BITM].nameOffset);
+    
+    //the clones are left for stripping
+    StripReport stripReport;
+    MapData stripped = stripDeadTags(merged, &stripReport);
+    CHECK(stripReport.result == STRIP_OK && stripReport.removedTags == 2);
+    MapData again = mergeDuplicateTags(stripped, &report);
+    CHECK(report.mergedTags == 0 && again.length == stripped.length && memcmp(again.buffer, stripped.buffer, stripped.length) == 0);
+    mapClose(&again);
+    mapClose(&stripped);
+    mapClose(&merged);
+    mapClose(&original);
+}
+
+static void testScan(void) {
+    char protectedPath[] = "/tmp/deathstar-scan-XXXXXX";
+    char cleanPath[] = "/tmp/deathstar-scan-XXXXXX";
+    int protectedFile = mkstemp(protectedPath);
+    int cleanFile = mkstemp(cleanPath);
+    CHECK(protectedFile >= 0 && cleanFile >= 0);
+    
+    //the bitmap stored as a weapon has no weapon parents beside it
+    MapData map = buildTestMap();
+    CHECK(saveMapToDescriptor(protectedFile, map) == 0);
+    memcpy(&testTags(map)[TEST_BITM].classA, BITM, 4);
+    CHECK(saveMapToDescriptor(cleanFile, map) == 0);
+    close(protectedFile);
+    close(cleanFile);
+    
+    const char *paths[] = { protectedPath, cleanPath, "/tmp/deathstar-scan-missing" };
+    MapScan scans[3];
+    scanMaps(paths, 3, scans, 2);
+    CHECK(scans[0].error == MAP_OK && scans[0].version == 609 && scans[0].tagCount == TEST_TAG_COUNT);
+    CHECK(scans[0].protected && scans[0].mismatchedClasses == 1 && scans[0].unknownClasses == 0);
+    CHECK(scans[0].invalidNameOffsets == 0 && scans[0].namesOutsideMeta == 0);
+    CHECK(scans[0].classCount == 7 && scans[0].classes[2].tagClass == testClass(BITM) && scans[0].classes[2].count == 3);
+    CHECK(scans[1].error == MAP_OK && !scans[1].protected && scans[1].mismatchedClasses == 0);
+    CHECK(scans[2].error == MAP_INVALID_PATH);
+    for(uint32_t i=0;i<3;i++) freeMapScan(&scans[i]);
+    
+    //a made-up class and a name past the end of the file
+    MapTag *tags = testTags(map);
+    memcpy(&tags[TEST_JUNK].classA, "xxxx", 4);
+    tags[TEST_PROJ].nameOffset = TEST_META_MEMORY_OFFSET + map.length;
+    CHECK(saveMap(cleanPath, map) == 0);
+    MapScan scan = scanMapAtPath(cleanPath);
+    CHECK(scan.protected && scan.unknownClasses == 1 && scan.invalidNameOffsets == 1);
+    freeMapScan(&scan);
+    
+    remove(protectedPath);
+    remove(cleanPath);
+    mapClose(&map);
+}
+
+#define TEST_POOL_MAPS 6
+
+static const char *testPoolPaths[TEST_POOL_MAPS] = { "first", "killed", "second", "stuck", "third", "fourth" };
+
+typedef struct {
+    PoolMapResult results[TEST_POOL_MAPS];
+    uint32_t reported[TEST_POOL_MAPS];
+} TestPool;
+
+static PoolMapResult testPoolMap(const char *path, void *context) { //in the worker
+    (void)context;
+    if(strcmp(path, "killed") == 0) raise(SIGKILL);
+    if(strcmp(path, "stuck") == 0) sleep(30);
+    PoolMapResult result;
+    result.status = POOL_MAP_SAVED;
+    result.checksum = (uint32_t)strlen(path);
+    result.signal = 0;
+    return result;
+}
+
+static void testPoolReport(const char *path, PoolMapResult result, void *context) {
+    TestPool *pool = context;
+    for(uint32_t i=0;i<TEST_POOL_MAPS;i++) {
+        if(strcmp(path, testPoolPaths[i]) != 0) continue;
+        pool->results[i] = result;
+        pool->reported[i]++;
+    }
+}
+
+static void testWorkerPool(void) {
+    //a worker that dies or hangs costs only its own map; the pool replaces it and carries on
+    TestPool pool;
+    memset(&pool, 0, sizeof(pool));
+    WorkerPoolOptions options;
+    options.workers = 2;
+    options.timeoutSeconds = 1;
+    options.processMap = testPoolMap;
+    options.reportResult = testPoolReport;
+    options.context = &pool;
+    CHECK(runWorkerPool(testPoolPaths, TEST_POOL_MAPS, options) == 0);
+    for(uint32_t i=0;i<TEST_POOL_MAPS;i++) CHECK(pool.reported[i] == 1);
+    CHECK(pool.results[1].status == POOL_MAP_CRASHED && pool.results[1].signal == SIGKILL);
+    CHECK(pool.results[3].status == POOL_MAP_TIMED_OUT);
+    CHECK(pool.results[0].status == POOL_MAP_SAVED && pool.results[0].checksum == 5);
+    CHECK(pool.results[2].status == POOL_MAP_SAVED && pool.results[4].status == POOL_MAP_SAVED);
+    CHECK(pool.results[5].status == POOL_MAP_SAVED && pool.results[5].checksum == 6);
+}
+
+typedef struct {
+    MapCache cache;
+    MapData map;
+    uint64_t hash;
+} TestCacheJob;
+
+static void *testCacheStores(void *context) {
+    TestCacheJob *job = context;
+    for(uint32_t i=0;i<0x40;i++) mapCacheStore(job->cache, job->hash, "deprotect", job->map);
+    return NULL;
+}
+
+static void testCache(void) {
+    char directory[] = "/tmp/deathstar-cache-XXXXXX";
+    CHECK(mkdtemp(directory) != NULL);
+    TestCacheJob job;
+    job.cache.directory = directory;
+    job.cache.maxBytes = MAP_CACHE_DEFAULT_LIMIT;
+    job.map = buildTestMap();
+    job.hash = hashMap(job.map);
+    
+    MapData missing = mapCacheLookup(job.cache, job.hash, "deprotect");
+    CHECK(missing.error != MAP_OK);
+    CHECK(mapCacheStore(job.cache, job.hash, "deprotect", job.map) == 0);
+    MapData found = mapCacheLookup(job.cache, job.hash, "deprotect");
+    CHECK(found.error == MAP_OK && found.length == job.map.length && memcmp(found.buffer, job.map.buffer, job.map.length) == 0);
+    mapClose(&found);
+    CHECK(mapCacheLookup(job.cache, job.hash, "zteam").error != MAP_OK);
+    CHECK(mapCacheLookup(job.cache, job.hash + 1, "deprotect").error != MAP_OK);
+    
+    //threads storing the same entry at once must leave one whole entry and no temporary files
+    pthread_t threads[4];
+    for(uint32_t i=0;i<4;i++) pthread_create(&threads[i], NULL, testCacheStores, &job);
+    for(uint32_t i=0;i<4;i++) pthread_join(threads[i], NULL);
+    found = mapCacheLookup(job.cache, job.hash, "deprotect");
+    CHECK(found.error == MAP_OK && found.length == job.map.length && memcmp(found.buffer, job.map.buffer, job.map.length) == 0);
+    mapClose(&found);
+    
+    //eviction only touches the cache's own entries, even in a directory that holds real maps
+    char path[0x200];
+    snprintf(path, sizeof(path), "%s/%s", directory, "real.map");
+    CHECK(saveMap(path, job.map) == 0);
+    snprintf(path, sizeof(path), "%s/%s", directory, "0123456789ABCDEF.deprotect.map");
+    CHECK(saveMap(path, job.map) == 0);
+    MapCache small = job.cache;
+    small.maxBytes = job.map.length + job.map.length / 2;
+    CHECK(mapCacheStore(small, job.hash + 1, "deprotect", job.map) == 0);
+    CHECK(mapCacheLookup(small, job.hash, "deprotect").error != MAP_OK);
+    found = mapCacheLookup(small, job.hash + 1, "deprotect");
+    CHECK(found.error == MAP_OK);
+    mapClose(&found);
+    snprintf(path, sizeof(path), "%s/%s", directory, "real.map");
+    found = openMapAtPath(path);
+    CHECK(found.error == MAP_OK);
+    mapClose(&found);
+    
+    uint32_t files = 0;
+    DIR *entries = opendir(directory);
+    struct dirent *entry;
+    while(entries && (entry = readdir(entries)) != NULL) {
+        if(entry->d_name[0] == '.') continue;
+        files++;
+        snprintf(path, sizeof(path), "%s/%s", directory, entry->d_name);
+        remove(path);
+    }
+    if(entries) closedir(entries);
+    CHECK(files == 3);
+    rmdir(directory);
+    mapClose(&job.map);
+}
+
+int main(void) {
+    testTagIndex();
+    testResolver();
+    testChecksum();
+    testParsePasses();
+    testOwnership();
+    testJournal();
+    testOutOfRangeTag();
+    testSweep();
+    testCoverage();
+    testDiff();
+    testStringTable();
+    testCompactNames();
+    testNameThreads();
+    testExtract();
+    testStrip();
+    testMerge();
+    testScan();
+    testCache();
+    testWorkerPool();
+    if(failures) {
+        printf("%u checks failed.\n", failures);
+        return 1;
+    }
+    printf("All checks passed.\n");
+    return 0;
+}